@@ -0,0 +1,89 @@
+/**
+ * # build the checksum benchmark
+ * make bench
+ * ./bin/geo_csum_bench [total_mb]
+ *
+ * Cross-checks every checksum kernel the CPU supports against the scalar
+ * one, then reports throughput for a range of packet sizes.
+ */
+// ===================== bench_csum.cpp =====================
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "utils_net.hpp"
+
+using namespace std;
+using namespace geo::net;
+
+static const CsumImpl kImpls[] = {CsumImpl::Scalar, CsumImpl::Sse2, CsumImpl::Avx2};
+
+// Random lengths and (mis)alignments; every kernel must agree with scalar.
+static bool cross_check(const vector<uint8_t> &buf)
+{
+    mt19937 rng(1);
+    for (int iter = 0; iter < 20000; ++iter)
+    {
+        size_t off = rng() % 64;
+        size_t len = rng() % (buf.size() - off);
+        uint32_t seed = rng();
+        uint16_t want = csum_fold(csum_partial_impl(CsumImpl::Scalar, buf.data() + off, len, seed));
+        for (CsumImpl impl : kImpls)
+        {
+            if (!csum_impl_supported(impl))
+                continue;
+            uint16_t got = csum_fold(csum_partial_impl(impl, buf.data() + off, len, seed));
+            if (got != want)
+            {
+                cerr << "mismatch: " << csum_impl_name(impl) << " off=" << off
+                     << " len=" << len << " got=" << got << " want=" << want << "\n";
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    size_t total_mb = argc > 1 ? strtoul(argv[1], nullptr, 10) : 256;
+
+    vector<uint8_t> buf(1 << 20);
+    mt19937 rng(42);
+    for (auto &b : buf)
+        b = static_cast<uint8_t>(rng());
+
+    if (!cross_check(buf))
+        return 1;
+    cout << "cross-check ok, active kernel: " << csum_impl_name(csum_active_impl()) << "\n\n";
+
+    const size_t sizes[] = {20, 40, 64, 128, 576, 1500, 9000, 65536};
+    cout << setw(8) << "bytes";
+    for (CsumImpl impl : kImpls)
+        if (csum_impl_supported(impl))
+            cout << setw(12) << csum_impl_name(impl);
+    cout << "   (GB/s)\n";
+
+    for (size_t sz : sizes)
+    {
+        cout << setw(8) << sz;
+        size_t iters = total_mb * (1 << 20) / sz;
+        for (CsumImpl impl : kImpls)
+        {
+            if (!csum_impl_supported(impl))
+                continue;
+            volatile uint32_t sink = 0;
+            auto t0 = chrono::steady_clock::now();
+            for (size_t i = 0; i < iters; ++i)
+                sink = csum_partial_impl(impl, buf.data() + (i & 63), sz, sink);
+            double s = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+            cout << setw(12) << fixed << setprecision(2) << (double(iters) * sz / s / 1e9);
+        }
+        cout << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,128 @@
+/**
+ * # build the geo JSON parser benchmark
+ * make bench
+ * ./bin/geo_json_bench [iterations]
+ *
+ * Cross-checks the single-pass ip-api parser (geo_json) against the old
+ * regex-per-field one on a set of sample answers, then reports the time
+ * per parsed answer for both.
+ */
+// ===================== bench_geo_json.cpp =====================
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "geo_json.hpp"
+
+using namespace std;
+using namespace geo;
+
+// The parser GeoResolver used before geo_json, kept as the reference
+static optional<GeoInfo> parse_regex(const string &body)
+{
+    if (body.find("\"status\":\"success\"") == string::npos)
+        return nullopt;
+
+    GeoInfo g{};
+    smatch m;
+    auto grab = [&](const regex &re)
+    { return regex_search(body, m, re) ? m[1].str() : string(); };
+
+    g.country = grab(regex("\"country\":\"([^\"]*)\""));
+    g.city = grab(regex("\"city\":\"([^\"]*)\""));
+    string slat = grab(regex("\"lat\":([-0-9.]+)"));
+    string slon = grab(regex("\"lon\":([-0-9.]+)"));
+    if (!slat.empty())
+        g.lat = stod(slat);
+    if (!slon.empty())
+        g.lon = stod(slon);
+    g.isp = grab(regex("\"isp\":\"([^\"]*)\""));
+    g.org = grab(regex("\"org\":\"([^\"]*)\""));
+    g.as_text = grab(regex("\"as\":\"([^\"]*)\""));
+    g.as_name = grab(regex("\"asname\":\"([^\"]*)\""));
+
+    smatch am;
+    if (regex_search(g.as_text, am, regex("(AS\\d+)")))
+        g.asn = am[1];
+    return g;
+}
+
+static const vector<string> kSamples = {
+    R"({"status":"success","country":"United States","city":"Mountain View","lat":37.4223,"lon":-122.085,)"
+    R"("isp":"Google LLC","org":"Google Public DNS","as":"AS15169 Google LLC","asname":"GOOGLE","query":"8.8.8.8"})",
+    R"({"status":"success","country":"Australia","city":"South Brisbane","lat":-27.4766,"lon":153.0166,)"
+    R"("isp":"Cloudflare, Inc","org":"APNIC and Cloudflare DNS Resolver project","as":"AS13335 Cloudflare, Inc.",)"
+    R"("asname":"CLOUDFLARENET","query":"1.1.1.1"})",
+    R"({"status":"success","country":"Singapore","city":"Singapore","lat":1.28967,"lon":103.85,"isp":"National )"
+    R"(University of Singapore","org":"","as":"AS7472 National University of Singapore","asname":"NUS-AS-AP"})",
+    R"({"status":"success","country":"Germany","city":"Frankfurt am Main","lat":50.1109,"lon":8.68213,)"
+    R"("isp":"","org":"","as":"","asname":""})",
+    R"({"status":"fail","message":"private range","query":"10.0.0.1"})",
+    R"({"status":"fail","message":"reserved range","query":"240.0.0.1"})",
+};
+
+// Escapes the regex parser can't handle: only geo_json is checked here
+static bool check_escapes()
+{
+    const string body = R"({"status":"success","country":"C\u00f4te d'Ivoire","city":"Abidjan \"Plateau\"",)"
+                        R"("lat":5.3,"lon":-4.0,"isp":"A\\B","org":"\ud83c\udf0d","as":"AS29571 Orange CI","asname":"X"})";
+    auto g = json::parse_ip_api(body);
+    return g && g->country == "C\xc3\xb4te d'Ivoire" && g->city == "Abidjan \"Plateau\"" && g->isp == "A\\B" &&
+           g->org == "\xf0\x9f\x8c\x8d" && g->asn == "AS29571" && g->lat == 5.3;
+}
+
+static bool same(const optional<GeoInfo> &a, const optional<GeoInfo> &b)
+{
+    if (!a || !b)
+        return !a && !b;
+    return a->country == b->country && a->city == b->city && a->lat == b->lat && a->lon == b->lon &&
+           a->isp == b->isp && a->org == b->org && a->as_text == b->as_text && a->asn == b->asn &&
+           a->as_name == b->as_name;
+}
+
+template <class F>
+static double ns_per_parse(size_t iters, F &&parse)
+{
+    volatile size_t sink = 0;
+    auto t0 = chrono::steady_clock::now();
+    for (size_t i = 0; i < iters; ++i)
+    {
+        auto g = parse(kSamples[i % kSamples.size()]);
+        sink = sink + (g ? g->city.size() : 1);
+    }
+    double s = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    return s * 1e9 / double(iters);
+}
+
+int main(int argc, char **argv)
+{
+    size_t iters = argc > 1 ? strtoul(argv[1], nullptr, 10) : 20000;
+    if (iters == 0)
+        iters = 1;
+
+    for (const auto &s : kSamples)
+        if (!same(parse_regex(s), json::parse_ip_api(s)))
+        {
+            cerr << "mismatch on: " << s << "\n";
+            return 1;
+        }
+    if (!check_escapes())
+    {
+        cerr << "escape handling mismatch\n";
+        return 1;
+    }
+    cout << "cross-check ok (" << kSamples.size() << " samples + escapes)\n\n";
+
+    const double re = ns_per_parse(iters, parse_regex);
+    const double js = ns_per_parse(iters * 100, [](const string &s) { return json::parse_ip_api(s); });
+    cout << setw(12) << "parser" << setw(14) << "ns/answer" << "\n"
+         << setw(12) << "regex" << setw(14) << fixed << setprecision(0) << re << "\n"
+         << setw(12) << "geo_json" << setw(14) << js << "\n"
+         << "\nspeedup: " << setprecision(1) << re / js << "x\n";
+    return 0;
+}
@@ -0,0 +1,380 @@
+/**
+ * # build and run the batched geo lookup check
+ * make check
+ * ./bin/geo_batch_check
+ *
+ * Points GeoResolver at a stand-in for ip-api.com on 127.0.0.1 and runs
+ * lookup_many() against scripted /batch answers: splitting into POSTs of
+ * 100, matching answers back by "query" (out of order, duplicate
+ * addresses), per-address "status":"fail" entries, and failed requests
+ * (non-200, truncated body, negative Content-Length) that must not be
+ * cached; then, with the in-memory cache off, request sharing and the
+ * disk cache. Exits non-zero if anything mismatched.
+ */
+// ===================== check_geo_batch.cpp =====================
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "geo_resolver.hpp"
+
+using namespace std;
+using namespace geo;
+
+// Minimal ip-api.com: HTTP/1.1 keep-alive, one thread per connection.
+// Every POST /batch is answered by the current handler, which gets the
+// addresses in the order they were sent.
+class StandIn
+{
+public:
+    struct Reply
+    {
+        int status = 200;
+        string body;
+        bool truncate = false; // promise more body than is sent, then close
+        string length = "";    // Content-Length to send instead of the real one, then close
+    };
+    using Handler = function<Reply(const vector<string> &ips)>;
+
+    StandIn()
+    {
+        fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        const int one = 1;
+        ::setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in a{};
+        a.sin_family = AF_INET;
+        a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(a);
+        if (::bind(fd_, reinterpret_cast<sockaddr *>(&a), sizeof(a)) != 0 || ::listen(fd_, 16) != 0 ||
+            ::getsockname(fd_, reinterpret_cast<sockaddr *>(&a), &len) != 0)
+        {
+            cerr << "stand-in: can't listen on 127.0.0.1\n";
+            exit(1);
+        }
+        port_ = ntohs(a.sin_port);
+        accept_ = thread([this] { accept_loop(); });
+    }
+
+    ~StandIn()
+    {
+        stop_ = true;
+        accept_.join();
+        ::close(fd_);
+        lock_guard<mutex> lk(mu_);
+        for (int c : conns_)
+            ::shutdown(c, SHUT_RDWR);
+        for (auto &t : workers_)
+            t.join();
+    }
+
+    uint16_t port() const { return port_; }
+
+    // New handler; also forgets the POSTs seen so far
+    void set(Handler h)
+    {
+        lock_guard<mutex> lk(mu_);
+        handler_ = move(h);
+        posts_.clear();
+    }
+
+    // Addresses per POST since the last set(), in arrival order
+    vector<size_t> posts()
+    {
+        lock_guard<mutex> lk(mu_);
+        return posts_;
+    }
+
+private:
+    void accept_loop()
+    {
+        while (!stop_)
+        {
+            pollfd p{fd_, POLLIN, 0};
+            if (::poll(&p, 1, 50) <= 0)
+                continue;
+            const int c = ::accept4(fd_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (c < 0)
+                continue;
+            lock_guard<mutex> lk(mu_);
+            conns_.push_back(c);
+            workers_.emplace_back([this, c] { serve(c); });
+        }
+    }
+
+    void serve(int c)
+    {
+        string buf;
+        char tmp[16384];
+        for (;;)
+        {
+            size_t head_end;
+            while ((head_end = buf.find("\r\n\r\n")) == string::npos)
+            {
+                const ssize_t n = ::recv(c, tmp, sizeof(tmp), 0);
+                if (n <= 0)
+                    return;
+                buf.append(tmp, static_cast<size_t>(n));
+            }
+            size_t length = 0;
+            const size_t cl = buf.find("Content-Length: ");
+            if (cl != string::npos && cl < head_end)
+                from_chars(buf.data() + cl + 16, buf.data() + head_end, length);
+            while (buf.size() < head_end + 4 + length)
+            {
+                const ssize_t n = ::recv(c, tmp, sizeof(tmp), 0);
+                if (n <= 0)
+                    return;
+                buf.append(tmp, static_cast<size_t>(n));
+            }
+            const bool post = buf.compare(0, 5, "POST ") == 0;
+            const string body = buf.substr(head_end + 4, length);
+            buf.erase(0, head_end + 4 + length);
+
+            // ["a","b",...]: every quoted string is an address
+            vector<string> ips;
+            for (size_t q = body.find('"'); q != string::npos; q = body.find('"', q + 1))
+            {
+                const size_t e = body.find('"', q + 1);
+                ips.push_back(body.substr(q + 1, e - q - 1));
+                q = e;
+            }
+
+            Reply r;
+            {
+                lock_guard<mutex> lk(mu_);
+                if (!post || !handler_)
+                    r.status = 404;
+                else
+                {
+                    posts_.push_back(ips.size());
+                    r = handler_(ips);
+                }
+            }
+            const size_t promised = r.body.size() + (r.truncate ? 64 : 0);
+            const string out = "HTTP/1.1 " + to_string(r.status) + " X\r\nContent-Type: application/json\r\n"
+                               "Content-Length: " + (r.length.empty() ? to_string(promised) : r.length) +
+                               "\r\n\r\n" + r.body;
+            if (::send(c, out.data(), out.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(out.size()) || r.truncate ||
+                !r.length.empty())
+            {
+                ::shutdown(c, SHUT_RDWR);
+                return;
+            }
+        }
+    }
+
+    int fd_ = -1;
+    uint16_t port_ = 0;
+    atomic<bool> stop_{false};
+    thread accept_;
+    mutex mu_;
+    vector<int> conns_;
+    vector<thread> workers_;
+    Handler handler_;
+    vector<size_t> posts_;
+};
+
+// ip-api's answer for one address; country and city derive from the address
+static string answer(const string &ip)
+{
+    return "{\"status\":\"success\",\"country\":\"C " + ip + "\",\"city\":\"City " + ip +
+           "\",\"lat\":1.5,\"lon\":-2.25,\"isp\":\"ISP\",\"org\":\"Org\",\"as\":\"AS64500 Org\","
+           "\"asname\":\"ORG\",\"query\":\"" + ip + "\"}";
+}
+
+static string failure(const string &ip)
+{
+    return "{\"status\":\"fail\",\"message\":\"reserved range\",\"query\":\"" + ip + "\"}";
+}
+
+static string array_of(const vector<string> &objs)
+{
+    string s = "[";
+    for (size_t i = 0; i < objs.size(); ++i)
+        s += (i ? "," : "") + objs[i];
+    return s + "]";
+}
+
+// Every address answered, in the order asked
+static StandIn::Reply in_order(const vector<string> &ips)
+{
+    vector<string> objs;
+    for (const auto &ip : ips)
+        objs.push_back(answer(ip));
+    return {200, array_of(objs), false};
+}
+
+// n distinct public-looking addresses under a.b.0.0/16 (special-purpose
+// space would never reach the stand-in)
+static vector<string> addresses(int a, int b, size_t n)
+{
+    vector<string> out;
+    for (size_t i = 0; i < n; ++i)
+        out.push_back(to_string(a) + "." + to_string(b) + "." + to_string(i / 250) + "." + to_string(1 + i % 250));
+    return out;
+}
+
+static int failures = 0;
+
+static void expect(bool cond, const string &what)
+{
+    if (!cond)
+    {
+        cerr << "FAIL: " << what << "\n";
+        failures++;
+    }
+}
+
+// One line per case; `before` is the failure count when it started
+static void report(const string &name, int before)
+{
+    cout << name << (failures == before ? ": ok\n" : ": FAILED\n");
+}
+
+// out[i] must be ips[i]'s answer from answer(), or nothing where !want[i]
+static void expect_answers(const vector<string> &ips, const vector<optional<GeoInfo>> &out,
+                           const vector<bool> &want, const string &what)
+{
+    expect(out.size() == ips.size(), what + ": result count");
+    for (size_t i = 0; i < min(ips.size(), out.size()); ++i)
+    {
+        if (!want[i])
+        {
+            expect(!out[i], what + ": expected no answer for " + ips[i]);
+            continue;
+        }
+        expect(out[i] && out[i]->ip == ips[i] && out[i]->country == "C " + ips[i] &&
+                   out[i]->city == "City " + ips[i] && out[i]->asn == "AS64500",
+               what + ": wrong answer for " + ips[i]);
+    }
+}
+
+int main()
+{
+    StandIn server;
+    GeoResolver::use_ip_api_host("127.0.0.1", server.port());
+
+    // 250 addresses -> POSTs of 100, 100 and 50
+    {
+        const int before = failures;
+        const auto ips = addresses(5, 1, 250);
+        server.set(in_order);
+        const auto out = GeoResolver::lookup_many(ips);
+        expect(server.posts() == vector<size_t>{100, 100, 50}, "chunking: POST sizes");
+        expect_answers(ips, out, vector<bool>(ips.size(), true), "chunking");
+        report("chunking at 100", before);
+    }
+
+    // answers in reverse order; one address asked for twice
+    {
+        const int before = failures;
+        auto ips = addresses(5, 2, 8);
+        ips.insert(ips.begin() + 6, ips[2]);
+        server.set([](const vector<string> &asked) {
+            vector<string> objs;
+            for (auto it = asked.rbegin(); it != asked.rend(); ++it)
+                objs.push_back(answer(*it));
+            return StandIn::Reply{200, array_of(objs), false};
+        });
+        const auto out = GeoResolver::lookup_many(ips);
+        expect_answers(ips, out, vector<bool>(ips.size(), true), "out of order / duplicates");
+        report("match by query", before);
+    }
+
+    // every third address fails on its own; the rest still answer
+    {
+        const int before = failures;
+        const auto ips = addresses(5, 3, 30);
+        server.set([](const vector<string> &asked) {
+            vector<string> objs;
+            for (size_t i = 0; i < asked.size(); ++i)
+                objs.push_back(i % 3 == 0 ? failure(asked[i]) : answer(asked[i]));
+            return StandIn::Reply{200, array_of(objs), false};
+        });
+        vector<bool> want(ips.size());
+        for (size_t i = 0; i < ips.size(); ++i)
+            want[i] = i % 3 != 0;
+        expect_answers(ips, GeoResolver::lookup_many(ips), want, "partial fail");
+        // "fail" is an answer about the address: cached, not asked again
+        server.set(in_order);
+        expect_answers(ips, GeoResolver::lookup_many(ips), want, "partial fail, cached");
+        expect(server.posts().empty(), "partial fail: answers were not cached");
+        report("status:fail entries", before);
+    }
+
+    // failed requests answer nothing and are not cached
+    const struct
+    {
+        const char *name;
+        StandIn::Reply reply;
+    } broken[] = {
+        {"non-200", {503, "{\"message\":\"busy\"}", false}},
+        {"truncated body", {200, "[" + answer("5.4.0.1"), true}},
+        // a full body, but an invalid length is a framing error, not "read to EOF"
+        {"negative Content-Length", {200, array_of({answer("5.6.0.1")}), false, "-5"}},
+    };
+    int net = 4;
+    for (const auto &b : broken)
+    {
+        const int before = failures;
+        const auto ips = addresses(5, net++, 20);
+        const StandIn::Reply reply = b.reply;
+        server.set([reply](const vector<string> &) { return reply; });
+        expect_answers(ips, GeoResolver::lookup_many(ips), vector<bool>(ips.size(), false), b.name);
+        server.set(in_order);
+        expect_answers(ips, GeoResolver::lookup_many(ips), vector<bool>(ips.size(), true),
+                       string(b.name) + ", retried");
+        expect(server.posts() == vector<size_t>{20}, string(b.name) + ": failure was cached");
+        report(b.name, before);
+    }
+
+    // no in-memory cache (--geo-ttl=0): concurrent lookups of one address
+    // still share a request, and the disk cache is still read and written
+    {
+        const int before = failures;
+        GeoCacheConfig cfg;
+        cfg.capacity = 0;
+        GeoResolver::configure_cache(cfg);
+        const string path = "/tmp/geo_batch_check." + to_string(::getpid()) + ".cache";
+        ::unlink(path.c_str());
+        GeoResolver::use_disk_cache(path);
+
+        const auto ips = addresses(5, 9, 10);
+        server.set([](const vector<string> &asked) {
+            this_thread::sleep_for(chrono::milliseconds(200)); // keep the request in flight
+            return in_order(asked);
+        });
+        vector<optional<GeoInfo>> first, second;
+        thread a([&] { first = GeoResolver::lookup_many(ips); });
+        this_thread::sleep_for(chrono::milliseconds(50));
+        thread b([&] { second = GeoResolver::lookup_many(ips); });
+        a.join();
+        b.join();
+        expect_answers(ips, first, vector<bool>(ips.size(), true), "ttl 0");
+        expect_answers(ips, second, vector<bool>(ips.size(), true), "ttl 0, concurrent");
+        expect(server.posts() == vector<size_t>{10}, "ttl 0: concurrent lookups were not coalesced");
+
+        server.set(in_order);
+        expect_answers(ips, GeoResolver::lookup_many(ips), vector<bool>(ips.size(), true), "ttl 0, disk");
+        expect(GeoResolver::lookup(ips[0]) && GeoResolver::lookup(ips[0])->ip == ips[0], "ttl 0, disk: lookup()");
+        expect(server.posts().empty(), "ttl 0: disk cache was not used");
+        ::unlink(path.c_str());
+        report("no memory cache, disk cache", before);
+    }
+
+    return failures ? 1 : 0;
+}
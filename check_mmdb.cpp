@@ -0,0 +1,373 @@
+/**
+ * # build and run the MaxMind DB reader check
+ * make check
+ * ./bin/geo_mmdb_check
+ *
+ * Writes small MaxMind DB files (IPv6 trees with IPv4 under ::/96, and an
+ * IPv4 tree; 24-, 28- and 32-bit records) whose data section uses
+ * pointers (short and long form, to values and to keys), long strings,
+ * arrays and extended types, then checks MmdbReader::lookup() hits and
+ * misses against them, and that truncated copies are rejected. Exits
+ * non-zero if anything mismatched.
+ */
+// ===================== check_mmdb.cpp =====================
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <unistd.h>
+
+#include "mmdb_reader.hpp"
+
+using namespace std;
+using namespace geo;
+
+// MaxMind DB field types used below
+enum : int { kPointer = 1, kString = 2, kDouble = 3, kUint16 = 5, kUint32 = 6, kMap = 7,
+             kUint64 = 9, kArray = 11, kBool = 14 };
+
+// Encoder for the data section and the metadata map
+struct Writer
+{
+    vector<uint8_t> out;
+
+    uint32_t pos() const { return static_cast<uint32_t>(out.size()); }
+
+    void ctrl(int type, uint32_t size)
+    {
+        const uint8_t hi = type <= 7 ? static_cast<uint8_t>(type << 5) : 0; // 0: extended type
+        out.push_back(hi | static_cast<uint8_t>(size < 29 ? size : size < 285 ? 29 : 30));
+        if (type > 7)
+            out.push_back(static_cast<uint8_t>(type - 7));
+        if (size >= 285)
+        {
+            out.push_back(static_cast<uint8_t>((size - 285) >> 8));
+            out.push_back(static_cast<uint8_t>(size - 285));
+        }
+        else if (size >= 29)
+            out.push_back(static_cast<uint8_t>(size - 29));
+    }
+
+    void be(uint64_t v, int n)
+    {
+        for (int i = n - 1; i >= 0; --i)
+            out.push_back(static_cast<uint8_t>(v >> (8 * i)));
+    }
+
+    void str(string_view s)
+    {
+        ctrl(kString, static_cast<uint32_t>(s.size()));
+        out.insert(out.end(), s.begin(), s.end());
+    }
+
+    void uint(int type, uint64_t v)
+    {
+        int n = 0;
+        while (n < 8 && (v >> (8 * n)))
+            ++n;
+        ctrl(type, static_cast<uint32_t>(n));
+        be(v, n);
+    }
+
+    void dbl(double d)
+    {
+        uint64_t bits;
+        memcpy(&bits, &d, sizeof(bits));
+        ctrl(kDouble, 8);
+        be(bits, 8);
+    }
+
+    void map(uint32_t pairs) { ctrl(kMap, pairs); }
+    void array(uint32_t n) { ctrl(kArray, n); }
+    void boolean(bool v) { ctrl(kBool, v ? 1 : 0); }
+
+    // Short (2-byte) form below 2048, long (3-byte) form above
+    void pointer(uint32_t off)
+    {
+        if (off < 2048)
+        {
+            out.push_back(static_cast<uint8_t>(kPointer << 5 | off >> 8));
+            out.push_back(static_cast<uint8_t>(off));
+            return;
+        }
+        const uint32_t v = off - 2048;
+        out.push_back(static_cast<uint8_t>(kPointer << 5 | 1 << 3 | v >> 16));
+        be(v, 2);
+    }
+};
+
+// Binary search tree over the address bits; a record is empty, another
+// node or a data section offset
+struct Tree
+{
+    enum Kind { Empty, Node, Data };
+    struct Rec
+    {
+        Kind kind = Empty;
+        uint32_t value = 0;
+    };
+    vector<array<Rec, 2>> nodes{1};
+
+    void insert(const vector<int> &bits, uint32_t data_off)
+    {
+        uint32_t node = 0;
+        for (size_t i = 0; i < bits.size(); ++i)
+        {
+            Rec &r = nodes[node][bits[i]];
+            if (i + 1 == bits.size())
+            {
+                r = {Data, data_off};
+                return;
+            }
+            if (r.kind != Node)
+            {
+                r = {Node, static_cast<uint32_t>(nodes.size())};
+                nodes.push_back({});
+            }
+            node = nodes[node][bits[i]].value;
+        }
+    }
+
+    vector<uint8_t> encode(int record_size) const
+    {
+        const uint32_t n = static_cast<uint32_t>(nodes.size());
+        auto value = [&](const Rec &r) { return r.kind == Empty ? n : r.kind == Node ? r.value : n + 16 + r.value; };
+        Writer w;
+        for (const auto &node : nodes)
+        {
+            const uint32_t l = value(node[0]), r = value(node[1]);
+            if (record_size == 24)
+            {
+                w.be(l, 3);
+                w.be(r, 3);
+            }
+            else if (record_size == 28)
+            {
+                w.be(l & 0xFFFFFF, 3);
+                w.out.push_back(static_cast<uint8_t>((l >> 24) << 4 | r >> 24));
+                w.be(r & 0xFFFFFF, 3);
+            }
+            else
+            {
+                w.be(l, 4);
+                w.be(r, 4);
+            }
+        }
+        return w.out;
+    }
+};
+
+// Prefix bits of an IPv4 network, under ::/96 in an IPv6 tree
+static vector<int> prefix(uint32_t net, int len, bool v6)
+{
+    vector<int> bits(v6 ? 96 : 0, 0);
+    for (int i = 0; i < len; ++i)
+        bits.push_back((net >> (31 - i)) & 1);
+    return bits;
+}
+
+static uint32_t ip4(int a, int b, int c, int d)
+{
+    return static_cast<uint32_t>(a) << 24 | static_cast<uint32_t>(b) << 16 | static_cast<uint32_t>(c) << 8 |
+           static_cast<uint32_t>(d);
+}
+
+static const uint8_t kMarker[] = {0xAB, 0xCD, 0xEF, 'M', 'a', 'x', 'M', 'i', 'n', 'd', '.', 'c', 'o', 'm'};
+
+// A City-style record for 1.2.3.0/24 and an ASN-style one for 5.6.0.0/16
+static vector<uint8_t> build(bool v6, int record_size)
+{
+    Writer d;
+    // shared country map; the records point at it
+    const uint32_t country = d.pos();
+    d.map(2);
+    d.str("iso_code");
+    d.str("TL");
+    const uint32_t names_key = d.pos();
+    d.str("names");
+    d.map(2);
+    d.str("de");
+    d.str("Testlandia");
+    d.str("en");
+    d.str("Testland");
+
+    const uint32_t city_rec = d.pos();
+    d.map(6);
+    d.str("city");
+    d.map(1);
+    d.pointer(names_key); // key by pointer, as the MaxMind writer dedups them
+    d.map(1);
+    d.str("en");
+    d.str("Testville");
+    d.str("continent"); // skipped: long string, array, extended types
+    d.map(3);
+    d.str("note");
+    d.str(string(2100, 'x'));
+    d.str("codes");
+    d.array(2);
+    d.str("EU");
+    d.uint(kUint64, 1ull << 40);
+    d.str("is_in_european_union");
+    d.boolean(true);
+    d.str("country");
+    d.pointer(country);
+    d.str("registered_country");
+    d.pointer(country);
+    d.str("location");
+    d.map(3);
+    d.str("accuracy_radius");
+    d.uint(kUint16, 100);
+    d.str("latitude");
+    d.dbl(51.5);
+    d.str("longitude");
+    d.dbl(-0.125);
+    d.str("postal");
+    d.map(1);
+    d.str("code");
+    d.str("TV1");
+
+    const uint32_t org = d.pos(); // past 2048: reached by a long pointer
+    d.str("Example Org");
+    const uint32_t reg = d.pos();
+    d.map(1);
+    d.str("names");
+    d.map(1);
+    d.str("en");
+    d.str("Regland");
+
+    const uint32_t asn_rec = d.pos();
+    d.map(3);
+    d.str("autonomous_system_number");
+    d.uint(kUint32, 64500);
+    d.str("autonomous_system_organization");
+    d.pointer(org);
+    d.str("registered_country");
+    d.pointer(reg);
+
+    Tree t;
+    t.insert(prefix(ip4(1, 2, 3, 0), 24, v6), city_rec);
+    t.insert(prefix(ip4(5, 6, 0, 0), 16, v6), asn_rec);
+
+    Writer m;
+    m.map(9);
+    m.str("binary_format_major_version");
+    m.uint(kUint16, 2);
+    m.str("binary_format_minor_version");
+    m.uint(kUint16, 0);
+    m.str("build_epoch");
+    m.uint(kUint64, 1700000000);
+    m.str("database_type");
+    m.str("GeoLite2-Check");
+    m.str("description");
+    m.map(1);
+    m.str("en");
+    m.str("geo_mmdb_check fixture");
+    m.str("languages");
+    m.array(1);
+    m.str("en");
+    m.str("ip_version");
+    m.uint(kUint16, v6 ? 6 : 4);
+    m.str("node_count");
+    m.uint(kUint32, t.nodes.size());
+    m.str("record_size");
+    m.uint(kUint16, static_cast<uint64_t>(record_size));
+
+    vector<uint8_t> file = t.encode(record_size);
+    file.insert(file.end(), 16, 0);
+    file.insert(file.end(), d.out.begin(), d.out.end());
+    file.insert(file.end(), begin(kMarker), end(kMarker));
+    file.insert(file.end(), m.out.begin(), m.out.end());
+    return file;
+}
+
+static int failures = 0;
+
+static void expect(bool cond, const string &what)
+{
+    if (!cond)
+    {
+        cerr << "FAIL: " << what << "\n";
+        failures++;
+    }
+}
+
+static void write_file(const string &path, const vector<uint8_t> &bytes, size_t n)
+{
+    ofstream f(path, ios::binary | ios::trunc);
+    f.write(reinterpret_cast<const char *>(bytes.data()), static_cast<streamsize>(n));
+}
+
+int main()
+{
+    const string path = "/tmp/geo_mmdb_check." + to_string(::getpid()) + ".mmdb";
+    const struct
+    {
+        bool v6;
+        int record_size;
+    } layouts[] = {{true, 24}, {true, 28}, {true, 32}, {false, 24}};
+
+    for (const auto &l : layouts)
+    {
+        const int before = failures;
+        const string name = string(l.v6 ? "IPv6" : "IPv4") + " tree, " + to_string(l.record_size) + "-bit records";
+        const vector<uint8_t> db = build(l.v6, l.record_size);
+        write_file(path, db, db.size());
+        try
+        {
+            MmdbReader r(path);
+            expect(r.database_type() == "GeoLite2-Check", name + ": database_type");
+
+            MmdbReader::Record rec;
+            expect(r.lookup(ip4(1, 2, 3, 4), rec), name + ": 1.2.3.4 missing");
+            expect(rec.city == "Testville", name + ": city via key pointer");
+            expect(rec.country == "Testland" && rec.country_iso == "TL", name + ": country via pointer");
+            expect(rec.has_location && rec.lat == 51.5 && rec.lon == -0.125, name + ": location");
+            expect(rec.asn == 0 && rec.as_org.empty(), name + ": city record has no ASN");
+
+            expect(r.lookup(ip4(5, 6, 255, 1), rec), name + ": 5.6.255.1 missing");
+            expect(rec.asn == 64500, name + ": ASN");
+            expect(rec.as_org == "Example Org", name + ": org via long pointer");
+            expect(rec.country == "Regland", name + ": registered_country fallback");
+            expect(rec.city.empty() && !rec.has_location, name + ": ASN record has no city");
+
+            expect(!r.lookup(ip4(1, 2, 4, 1), rec), name + ": 1.2.4.1 should miss");
+            expect(!r.lookup(ip4(9, 9, 9, 9), rec), name + ": 9.9.9.9 should miss");
+            expect(!r.lookup(ip4(5, 7, 0, 1), rec), name + ": 5.7.0.1 should miss");
+        }
+        catch (const exception &e)
+        {
+            expect(false, name + ": " + e.what());
+        }
+        cout << name << (failures == before ? ": ok\n" : ": FAILED\n");
+    }
+
+    // cut short: before the marker ends, inside the tree, inside the metadata
+    {
+        const int before = failures;
+        const vector<uint8_t> db = build(true, 24);
+        for (size_t n : {size_t{1}, sizeof(kMarker) - 1, sizeof(kMarker), size_t{20}, db.size() / 2, db.size() - 3})
+        {
+            write_file(path, db, n);
+            bool threw = false;
+            try
+            {
+                MmdbReader r(path);
+            }
+            catch (const runtime_error &)
+            {
+                threw = true;
+            }
+            expect(threw, "truncated to " + to_string(n) + " bytes was accepted");
+        }
+        cout << "truncated files" << (failures == before ? ": ok\n" : ": FAILED\n");
+    }
+
+    ::unlink(path.c_str());
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <linux/filter.h>
+
+namespace geo::bpf {
+
+// Inclusive source-port range our probes use
+struct PortRange {
+    uint16_t lo;
+    uint16_t hi;
+};
+
+// Destination sets bigger than this skip the per-address check (classic
+// BPF jumps are 8-bit); the port and type checks still apply.
+constexpr std::size_t kMaxAddrs = 200;
+
+// Raw IPPROTO_TCP sniff socket: only SYN-ACK or RST segments coming from one
+// of `dsts` (network order) and addressed to a port in `ports`.
+std::vector<sock_filter> tcp_reply_filter(const std::vector<uint32_t>& dsts, PortRange ports);
+
+// Raw IPPROTO_ICMP socket: only Time Exceeded messages quoting a TCP probe
+// sent to one of `dsts` from a port in `ports`.
+std::vector<sock_filter> icmp_time_exceeded_filter(const std::vector<uint32_t>& dsts, PortRange ports);
+
+// AF_PACKET (SOCK_DGRAM) ring carrying both kinds of reply: the two
+// programs above behind a protocol switch, minus our own outgoing packets.
+std::vector<sock_filter> reply_filter(const std::vector<uint32_t>& dsts, PortRange ports);
+
+// SO_ATTACH_FILTER; false if the kernel refused it
+bool attach(int fd, const std::vector<sock_filter>& prog);
+
+} // namespace geo::bpf
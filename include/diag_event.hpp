@@ -0,0 +1,163 @@
+// ===================== File: include/diag_event.hpp =====================
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace geo::diag {
+
+// Typed diagnostic events. Each one is a fixed 32-byte Record; Text and
+// TargetName carry `len` payload bytes right after it. Binary logs are a
+// plain sequence of these (native byte order), one LogStart per session.
+enum class Event : uint8_t {
+    LogStart = 1,
+    LogEnd,
+    Text,             // free-form line (setup, warnings, heuristics)
+    TargetName,       // payload = host; kind = 1 if its lines get a "[host] " tag
+    ProbeSent,
+    ProbeSendErr,
+    HopSend,
+    IcmpTimeExceeded,
+    IcmpUnmatched,
+    DestReply,
+    HopSummary,
+    NoIcmpThisHop,
+    HopCancel,
+    Stop,
+    ParallelTtl,
+    ConnectResult,
+    SweepReply,
+};
+
+enum class ProbeKind : uint8_t { Raw, Packet, Connect, Sweep };
+enum class ReplyKind : uint8_t { Icmp, SynAck, Rst };
+
+struct Record {
+    int64_t ts_ns = 0;  // CLOCK_REALTIME, filled in by DiagLogger::event()
+    uint8_t type = 0;   // Event
+    uint8_t kind = 0;   // ProbeKind / ReplyKind / flag, per event
+    uint8_t ttl = 0;
+    uint8_t idx = 0;    // probe number within its hop
+    uint16_t sport = 0;
+    uint16_t len = 0;   // payload bytes that follow
+    uint32_t target = 0;
+    uint32_t addr = 0;  // network order
+    int64_t value = 0;  // rtt_ns / bytes / errno / count, per event
+};
+static_assert(sizeof(Record) == 32, "diag::Record is an on-disk format");
+
+inline Record make(Event e, uint32_t target = 0) {
+    Record r;
+    r.type = static_cast<uint8_t>(e);
+    r.target = target;
+    return r;
+}
+
+// result: bytes sent, or -errno
+inline Record probe_sent(ProbeKind kind, uint32_t target, int ttl, int idx, uint16_t sport, int result) {
+    Record r = make(result < 0 ? Event::ProbeSendErr : Event::ProbeSent, target);
+    r.kind = static_cast<uint8_t>(kind);
+    r.ttl = static_cast<uint8_t>(ttl);
+    r.idx = static_cast<uint8_t>(idx);
+    r.sport = sport;
+    r.value = result < 0 ? -result : result;
+    return r;
+}
+
+inline Record hop_send(uint32_t target, int ttl, int probes) {
+    Record r = make(Event::HopSend, target);
+    r.ttl = static_cast<uint8_t>(ttl);
+    r.value = probes;
+    return r;
+}
+
+inline Record icmp_time_exceeded(uint32_t target, uint32_t from, uint16_t sport, int inner_ttl, int64_t rtt_ns) {
+    Record r = make(Event::IcmpTimeExceeded, target);
+    r.addr = from;
+    r.sport = sport;
+    r.ttl = static_cast<uint8_t>(inner_ttl);
+    r.value = rtt_ns;
+    return r;
+}
+
+inline Record icmp_unmatched(uint16_t sport) {
+    Record r = make(Event::IcmpUnmatched);
+    r.sport = sport;
+    return r;
+}
+
+inline Record dest_reply(uint32_t target, bool synack, uint16_t sport, int64_t rtt_ns) {
+    Record r = make(Event::DestReply, target);
+    r.kind = static_cast<uint8_t>(synack ? ReplyKind::SynAck : ReplyKind::Rst);
+    r.sport = sport;
+    r.value = rtt_ns;
+    return r;
+}
+
+inline Record hop_summary(uint32_t target, int ttl, int replies, bool reached) {
+    Record r = make(Event::HopSummary, target);
+    r.ttl = static_cast<uint8_t>(ttl);
+    r.kind = reached ? 1 : 0;
+    r.value = replies;
+    return r;
+}
+
+// NoIcmpThisHop, HopCancel, Stop
+inline Record hop_event(Event e, uint32_t target, int ttl) {
+    Record r = make(e, target);
+    r.ttl = static_cast<uint8_t>(ttl);
+    return r;
+}
+
+inline Record parallel_ttl(uint32_t target, int window) {
+    Record r = make(Event::ParallelTtl, target);
+    r.value = window;
+    return r;
+}
+
+inline Record connect_result(uint32_t target, uint16_t sport, int err) {
+    Record r = make(Event::ConnectResult, target);
+    r.sport = sport;
+    r.value = err;
+    return r;
+}
+
+inline Record sweep_reply(uint32_t target, ReplyKind kind, int ttl, uint32_t from, int64_t rtt_ns) {
+    Record r = make(Event::SweepReply, target);
+    r.kind = static_cast<uint8_t>(kind);
+    r.ttl = static_cast<uint8_t>(ttl);
+    r.addr = from;
+    r.value = rtt_ns;
+    return r;
+}
+
+// Target names seen so far (TargetName records), for rendering tags
+class NameTable {
+public:
+    void set(uint32_t target, const char* name, std::size_t len, bool tag_lines);
+    const std::string& name(uint32_t target) const;
+    const std::string& tag(uint32_t target) const; // "[host] " or ""
+
+private:
+    std::vector<std::string> names_;
+    std::vector<std::string> tags_;
+};
+
+// Append the text form of `r` (no timestamp, no newline) to `out`, exactly
+// as the text log has always written it. TargetName records only update
+// `names` and render nothing; returns false for those (and LogStart/LogEnd).
+bool render(std::string& out, const Record& r, const char* payload, NameTable& names);
+
+// "YYYY-MM-DD HH:MM:SS.mmm" in local time; localtime_r() only runs when the
+// second changes. Not thread-safe: one per writer.
+class Timestamp {
+public:
+    const char* format(int64_t ts_ns);
+
+private:
+    int64_t sec_ = -1;
+    char buf_[24] = {};
+};
+
+} // namespace geo::diag
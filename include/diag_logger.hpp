@@ -1,20 +1,85 @@
 // ===================== File: include/diag_logger.hpp =====================
 #pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <fstream>
+#include <memory>
 #include <string>
+#include <thread>
+#include "diag_event.hpp"
 
 namespace geo {
 
+// DiagLogger: timestamped diagnostics appended to a file.
+//
+// Everything is a diag::Record: log() sends a Text record, event() a typed
+// one. Format::Text renders the familiar "<time> | LINE" output;
+// Format::Binary appends the raw 32-byte records (decode with geo_diagdump).
+//
+// Sync: records are written on the calling thread (text lines are flushed
+// one by one, binary records in 64 KiB chunks and at the end).
+// Async: the record is copied into a lock-free ring and the call returns; a
+// writer thread renders and writes whole batches. If the ring is full the
+// record is dropped and counted (reported in the log), so probing never
+// waits on disk. Target names are the exception: later lines of that target
+// can't be rendered without them, so name_target() waits for room instead
+// (it is only called while a batch is being set up).
 class DiagLogger {
 public:
-    explicit DiagLogger(const std::string& path);
+    enum class Mode { Sync, Async };
+    enum class Format { Text, Binary };
+
+    explicit DiagLogger(const std::string& path, Mode mode = Mode::Sync, Format format = Format::Text);
     ~DiagLogger();
 
+    DiagLogger(const DiagLogger&) = delete;
+    DiagLogger& operator=(const DiagLogger&) = delete;
+
     bool ok() const { return out_.is_open(); }
     void log(const std::string& line);
+    void event(diag::Record r);
+
+    // Name batch index `target` for later events; tag_lines prefixes its
+    // trace lines with "[host] ".
+    void name_target(uint32_t target, const std::string& name, bool tag_lines);
+
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
 
 private:
+    static constexpr std::size_t kSlots = 4096;     // power of two
+    static constexpr std::size_t kMaxPayload = 216; // longer text is cut; Slot = 256 bytes
+
+    struct Slot {
+        std::atomic<uint64_t> seq{0};
+        diag::Record rec;
+        char payload[kMaxPayload];
+    };
+
+    void emit(diag::Record r, const char* payload, bool wait = false);
+    void write(const diag::Record& r, const char* payload);
+    void writer_loop();
+    bool drain();
+
     std::ofstream out_;
+    Mode mode_;
+    Format format_;
+
+    // writer side (the calling thread in Sync mode)
+    diag::Timestamp stamp_;
+    diag::NameTable names_;
+    std::string line_;
+    std::string buf_;
+
+    // async ring (multi-producer, single consumer)
+    std::unique_ptr<Slot[]> slots_;
+    std::atomic<uint64_t> head_{0};
+    uint64_t tail_ = 0; // writer only
+    std::atomic<uint64_t> dropped_{0};
+    uint64_t dropped_reported_ = 0;
+    std::atomic<bool> stop_{false};
+    std::thread writer_;
 };
 
 } // namespace geo
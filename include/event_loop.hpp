@@ -0,0 +1,57 @@
+// ===================== File: include/event_loop.hpp =====================
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <sys/epoll.h>
+#include "timer_wheel.hpp"
+
+namespace geo {
+
+// EventLoop: tiny epoll reactor + timer wheel.
+//
+// fds are registered with a handler that gets the epoll event mask, or with
+// a plain tag for the loop's one shared tag handler (per-probe sockets: no
+// closure to store, so registering one never allocates). Timers live in a
+// TimerWheel; expired tokens are handed back from poll_once() so the owner
+// can match them against its own state.
+class EventLoop {
+public:
+    using Handler = std::function<void(uint32_t events)>;
+    using TagHandler = std::function<void(uint64_t tag, uint32_t events)>;
+
+    EventLoop();   // throws std::runtime_error if epoll is unavailable
+    ~EventLoop();
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    bool watch(int fd, uint32_t events, Handler h);
+    // events on fd go to the tag handler along with `tag`
+    bool watch_tagged(int fd, uint32_t events, uint64_t tag);
+    void set_tag_handler(TagHandler h) { tag_handler_ = std::move(h); }
+    bool rearm(int fd, uint32_t events);   // for EPOLLONESHOT registrations
+    void unwatch(int fd);                  // call before closing fd
+
+    TimerWheel& timers() { return timers_; }
+
+    // Wait for I/O up to the next timer (capped by max_wait_ms, -1 = no cap),
+    // dispatch handlers, then append expired timer tokens to `expired`.
+    // Returns the number of fd events dispatched.
+    int poll_once(int max_wait_ms, std::vector<uint64_t>& expired);
+
+private:
+    bool add(int fd, uint32_t events); // epoll_ctl + grow the per-fd tables
+
+    int epfd_ = -1;
+    std::vector<Handler> handlers_;   // indexed by fd
+    std::vector<uint64_t> tags_;      // indexed by fd, for watch_tagged()
+    std::vector<uint8_t> live_;       // indexed by fd: kNone, kHandler or kTagged
+    std::vector<int> dead_;           // handlers to drop once dispatch is done
+    std::vector<epoll_event> events_;
+    bool dispatching_ = false;
+    TagHandler tag_handler_;
+    TimerWheel timers_;
+};
+
+} // namespace geo
@@ -0,0 +1,76 @@
+// ===================== File: include/geo_cache_file.hpp =====================
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include "geo_resolver.hpp"
+
+namespace geo {
+
+// GeoCacheFile: geo lookups persisted across runs in one mmapped file.
+//
+//   [header 64 B][slot table: slot_count x 48 B][string heap]
+//
+// The slot table is open-addressed (linear probing) on the IPv4 address;
+// each slot holds lat/lon, an expiry (unix seconds), a negative flag and
+// the offset/lengths of its strings in the append-only heap. Opening the
+// file is just open + mmap, whatever its size.
+//
+// Readers (any number of processes) take no locks: every slot carries a
+// sequence counter that writers make odd while they update it. Writers
+// serialize on flock(). When the table or heap fills up, the writer copies
+// the live entries into a fresh file, rename()s it over the old one and
+// marks the old one retired so other processes remap on their next call.
+class GeoCacheFile {
+public:
+    static constexpr uint32_t kDefaultSlots = 1u << 16;
+    static constexpr uint64_t kDefaultHeap = 4u << 20;
+
+    GeoCacheFile() = default;
+    ~GeoCacheFile();
+
+    GeoCacheFile(const GeoCacheFile&) = delete;
+    GeoCacheFile& operator=(const GeoCacheFile&) = delete;
+
+    // Open (or create) `path`. Throws std::runtime_error if it can't be
+    // opened or isn't a cache file. Falls back to read-only if the file
+    // isn't writable.
+    void open(const std::string& path);
+    bool is_open() const { return base_ != nullptr; }
+
+    // ip in host order. True if there is an unexpired entry: `out` is the
+    // cached answer (nullopt for a cached failure) and `expires` its expiry.
+    bool find(uint32_t ip, std::optional<GeoInfo>& out, std::chrono::system_clock::time_point& expires);
+
+    // Insert or refresh `ip`, valid for `ttl`. Silently does nothing on a
+    // read-only file or an I/O error; the cache is only an optimization.
+    void store(uint32_t ip, const std::optional<GeoInfo>& info, std::chrono::seconds ttl);
+
+private:
+    struct Header;
+    struct Slot;
+
+    bool map_file(int fd, bool writable);
+    void unmap();
+    void reopen_if_retired(); // exclusive lock on map_mu_ inside
+    bool retired() const;
+    Header* header() const;
+    Slot* slots() const;
+    char* heap() const;
+    bool compact(uint32_t need_heap); // under the writer locks
+
+    std::string path_;
+    int fd_ = -1;
+    bool writable_ = false;
+    char* base_ = nullptr;
+    std::size_t size_ = 0;
+
+    mutable std::shared_mutex map_mu_; // shared: using the mapping; exclusive: remapping
+    std::mutex write_mu_;              // flock() doesn't order threads of one process
+};
+
+} // namespace geo
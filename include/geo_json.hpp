@@ -0,0 +1,63 @@
+// ===================== File: include/geo_json.hpp =====================
+#pragma once
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "geo_resolver.hpp"
+
+namespace geo::json {
+
+// One member value, as a view into the scanned text. Strings are the raw
+// bytes between the quotes (`escaped` if they contain a backslash);
+// objects and arrays span their brackets.
+struct Value {
+    enum Kind { String, Number, Literal, Object, Array } kind = Literal;
+    std::string_view raw;
+    bool escaped = false;
+};
+
+// Walks the members of one JSON object in a single pass, without copying.
+// Nested objects/arrays are stepped over, not parsed. Keys are compared
+// raw, so escaped keys are never matched (ip-api never sends any).
+class ObjectScanner {
+public:
+    // `text` may have leading whitespace before the '{'
+    explicit ObjectScanner(std::string_view text);
+
+    // Next member, or false at the closing '}' or on malformed input
+    bool next(std::string_view& key, Value& value);
+    // False if scanning stopped on malformed input
+    bool ok() const { return ok_; }
+    // Offset just past the closing '}' once next() has returned false
+    std::size_t end() const { return pos_; }
+
+private:
+    bool fail();
+
+    std::string_view s_;
+    std::size_t pos_ = 0;
+    bool ok_ = true;
+    bool done_ = false;
+    bool first_ = true;
+};
+
+// A string value, unescaped (\uXXXX, surrogate pairs included, as UTF-8).
+// False if `v` isn't a string or has a bad escape; `out` is then empty.
+bool string(const Value& v, std::string& out);
+// A number value. False if `v` isn't a number.
+bool number(const Value& v, double& out);
+
+// The top-level objects of a JSON array, as views into `text`
+std::vector<std::string_view> array_objects(std::string_view text);
+
+// One ip-api result object -> GeoInfo, nullopt unless "status":"success".
+// `ip` is left empty. `query` (if given) receives the "query" field, which
+// /batch answers carry even on failure.
+std::optional<GeoInfo> parse_ip_api(std::string_view obj, std::string* query = nullptr);
+
+// First "AS<digits>" in `as_text` (ip-api's "as" field), or empty
+std::string_view asn_prefix(std::string_view as_text);
+
+} // namespace geo::json
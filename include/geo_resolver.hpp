@@ -1,8 +1,19 @@
 //// ===================== File: include/geo_resolver.hpp =====================
 #pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
 #include <string>
 #include <optional>
+#include <string_view>
+#include <thread>
+#include <vector>
 
+#include "ip_prefix.hpp"
 
 namespace geo {
 struct GeoInfo {
@@ -19,9 +30,92 @@ std::string asn; // e.g., "AS15169"
 std::string as_name; // e.g., "GOOGLE"
 };
 
+// In-process cache in front of lookup(), keyed by IPv4 address.
+// Failures (no answer, "status":"fail") are cached for negative_ttl.
+struct GeoCacheConfig {
+std::size_t capacity = 4096; // entries; 0 keeps nothing in memory (lookups
+                             // are still coalesced, the disk cache still used)
+std::chrono::seconds ttl{3600}; // also how long disk cache entries last
+std::chrono::seconds negative_ttl{300};
+};
+
+struct GeoCacheStats {
+uint64_t hits = 0;       // answered from the cache (negative hits included)
+uint64_t negative_hits = 0;
+uint64_t disk_hits = 0;  // answered from the on-disk cache
+uint64_t misses = 0;     // went to the network
+uint64_t coalesced = 0;  // waited on another thread's request for the same IP
+uint64_t evictions = 0;
+};
+
 
 class GeoResolver {
 public:
+// Thread-safe. Concurrent lookups of one IP share a single request.
+// Addresses local_prefix() matches are answered with nullopt without any
+// lookup.
 static std::optional<GeoInfo> lookup(const std::string& ip);
+
+// Same answers as lookup() for every entry of `ips` (in order), but the
+// uncached ones go out as ip-api /batch POSTs of up to 100 addresses.
+static std::vector<std::optional<GeoInfo>> lookup_many(const std::vector<std::string>& ips);
+
+// Also empties the cache.
+static void configure_cache(const GeoCacheConfig& cfg);
+
+// Answer from a local MaxMind DB file (GeoLite2 City/Country/ASN format)
+// before any cache or network; call once per file, before the first lookup.
+// ip-api is only asked about addresses none of the files cover.
+// Throws std::runtime_error.
+static void use_offline_db(const std::string& path);
+
+// Back the in-memory cache with a file shared across runs and processes
+// (see GeoCacheFile); created if missing. Throws std::runtime_error.
+static void use_disk_cache(const std::string& path);
+
+// Send ip-api requests to host:port instead of ip-api.com:80 (a mirror, or
+// a local stand-in under test); call before the first lookup.
+static void use_ip_api_host(const std::string& host, uint16_t port = 80);
+
+// Hops never worth a lookup: IANA special-purpose space (private, CGNAT,
+// loopback, documentation, ...) plus whatever add_local_prefix() added.
+// Returns the longest matching entry or nullptr; ip in host order.
+static const PrefixClassifier::Label* local_prefix(uint32_t ip);
+static const PrefixClassifier::Label* local_prefix(const std::string& ip);
+// Add a CIDR (Kind::User) to that table; call before the first lookup.
+// Throws std::invalid_argument on a malformed prefix.
+static void add_local_prefix(std::string_view cidr, std::string label);
+static GeoCacheStats cache_stats();
+};
+
+// Geo lookups started as soon as an address is known, off the caller's
+// thread. At most `workers` requests are in flight; addresses queued while
+// they are busy go out together as one lookup_many(). `done` runs on a
+// worker thread, once per submitted address.
+class GeoLookupQueue {
+public:
+using Done = std::function<void(const std::string& ip, const std::optional<GeoInfo>& info)>;
+
+explicit GeoLookupQueue(Done done, std::size_t workers = 4);
+~GeoLookupQueue(); // finishes everything submitted first
+
+GeoLookupQueue(const GeoLookupQueue&) = delete;
+GeoLookupQueue& operator=(const GeoLookupQueue&) = delete;
+
+void submit(std::string ip);
+// Block until every address submitted so far has been answered
+void wait();
+
+private:
+void work();
+
+Done done_;
+std::mutex mu_;
+std::condition_variable cv_;      // workers: queue non-empty or stopping
+std::condition_variable idle_cv_; // wait(): nothing queued or running
+std::deque<std::string> queue_;
+std::size_t running_ = 0;
+bool stop_ = false;
+std::vector<std::thread> threads_;
 };
-} // namespace geo
\ No newline at end of file
+} // namespace geo
@@ -0,0 +1,73 @@
+// ===================== File: include/http_client.hpp =====================
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "dns_resolver.hpp"
+
+namespace geo {
+
+struct HttpRequest {
+    std::string method = "GET";
+    std::string path;         // origin form: "/json/8.8.8.8?fields=..."
+    std::string body;         // sent with Content-Length when non-empty
+    std::string content_type; // optional
+};
+
+struct HttpResponse {
+    int status = 0; // 0: no (complete) response
+    std::string body;
+};
+
+// HttpClient: plain HTTP/1.1 to one host over a small pool of keep-alive
+// connections. The host is resolved once; a request takes an idle
+// connection if there is one, so repeated calls skip DNS and the TCP
+// handshake. Responses are framed by Content-Length or chunked encoding
+// (read-to-close only when the server sends neither). Thread-safe: each
+// call has a connection to itself for its duration.
+class HttpClient {
+public:
+    struct Stats {
+        uint64_t requests = 0;
+        uint64_t connects = 0; // new TCP connections
+        uint64_t reused = 0;   // calls served on a pooled connection
+        uint64_t retries = 0;  // pooled connection found dead, request resent
+    };
+
+    explicit HttpClient(std::string host, uint16_t port = 80, std::size_t max_idle = 4);
+    ~HttpClient();
+
+    HttpClient(const HttpClient&) = delete;
+    HttpClient& operator=(const HttpClient&) = delete;
+
+    HttpResponse request(const HttpRequest& req);
+
+    // All of `reqs` written back to back on one connection, responses read
+    // in order (HTTP/1.1 pipelining). If the server closes early, the rest
+    // go out on a new connection. Failed entries have status 0.
+    std::vector<HttpResponse> pipeline(const std::vector<HttpRequest>& reqs);
+
+    Stats stats() const;
+
+private:
+    struct Conn;
+
+    std::unique_ptr<Conn> checkout(bool& reused);
+    void checkin(std::unique_ptr<Conn> c);
+    std::unique_ptr<Conn> connect();
+    void append_request(std::string& wire, const HttpRequest& req) const;
+
+    const std::string host_;
+    const uint16_t port_;
+    const std::size_t max_idle_;
+
+    mutable std::mutex mu_;
+    std::vector<ResolvedAddress> addrs_; // cached resolution of host_
+    std::vector<std::unique_ptr<Conn>> idle_;
+    Stats stats_;
+};
+
+} // namespace geo
@@ -1,8 +1,12 @@
 
 //// ===================== File: include/icmp_listener.hpp =====================
 #pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <optional>
-#include <string>
+#include <vector>
+#include "recv_ring.hpp"
 
 namespace geo
 {
@@ -11,20 +15,45 @@ namespace geo
     public:
         struct TimeExceeded
         {
-            std::string from_ip; // router that sent ICMP
+            uint32_t from_addr;  // router that sent ICMP (network order)
             uint16_t orig_sport; // source port of our original TCP probe
             int orig_ttl;        // TTL of the dropped probe (best-effort)
+
+            // rest of the quote, for probes that describe themselves
+            uint32_t orig_dst;   // inner destination (network order)
+            uint16_t orig_dport; // destination port of the probe
+            uint16_t orig_ip_id; // IP-ID of the probe (host order)
+            uint32_t orig_seq;   // TCP sequence number (host order)
+
+            std::chrono::steady_clock::time_point rx_time; // kernel RX stamp, else when we picked it up
         };
 
         enum class OpenMode { RawOnly, DatagramOnly, Auto };  // <-- new
 
+        IcmpListener() = default;
+        ~IcmpListener() { close(); } // so a throw after open() can't leak the socket
+        IcmpListener(const IcmpListener &) = delete;
+        IcmpListener &operator=(const IcmpListener &) = delete;
+
         bool open(OpenMode mode = OpenMode::RawOnly);  // <-- changed
         void close();
         int fd() const { return fd_; }
+        bool is_raw() const { return raw_; } // SOCK_RAW (sees full IP datagrams)
+
+        // One datagram into the caller's buffer (nothing is cleared first)
+        std::optional<TimeExceeded> recv_time_exceeded(uint8_t* buf, std::size_t cap);
+
+        // Drain whatever is queued (one recvmmsg(), up to RecvRing::kSlots
+        // datagrams) and return the Time Exceeded replies among them. The
+        // vector is reused by the next call.
+        const std::vector<TimeExceeded>& recv_time_exceeded_batch();
 
-        std::optional<TimeExceeded> recv_time_exceeded();
+        static std::optional<TimeExceeded> parse_time_exceeded(const uint8_t* buf, std::size_t n);
 
     private:
         int fd_ = -1;
+        bool raw_ = false;
+        RecvRing ring_;
+        std::vector<TimeExceeded> batch_;
     };
 } // namespace geo
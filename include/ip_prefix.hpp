@@ -0,0 +1,92 @@
+// ===================== File: include/ip_prefix.hpp =====================
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <netinet/in.h>
+
+namespace geo {
+
+// PrefixClassifier: longest-prefix match of IPv4/IPv6 addresses against a
+// labelled prefix list. The list is compiled into sorted, disjoint address
+// ranges, each carrying the label of the longest prefix covering it, so
+// classify() is one binary search over integers. Compiling happens once,
+// on the first classify() after add()s.
+//
+// classify() may be called from any number of threads; add() must not run
+// concurrently with anything else.
+class PrefixClassifier {
+public:
+    enum class Kind : uint8_t {
+        Local,    // our side of the path: private-use, shared (CGNAT), link-local, unique-local
+        Reserved, // any other special-purpose block
+        User,     // added by the caller
+    };
+
+    struct Label {
+        std::string name;
+        Kind kind;
+    };
+
+    enum class Preset {
+        Empty,
+        // IANA IPv4 and IPv6 Special-Purpose Address Registries (plus
+        // multicast): private, CGNAT, loopback, link-local, documentation,
+        // benchmarking, reserved, ...
+        SpecialPurpose,
+    };
+
+    explicit PrefixClassifier(Preset preset = Preset::Empty);
+
+    PrefixClassifier(const PrefixClassifier&) = delete;
+    PrefixClassifier& operator=(const PrefixClassifier&) = delete;
+
+    // "10.0.0.0/8", "fc00::/7" or a bare address (/32, /128). Host bits are
+    // ignored. A more specific prefix wins over the ones containing it, and
+    // a later add() of the same prefix over an earlier one.
+    // Throws std::invalid_argument on a malformed prefix.
+    void add(std::string_view cidr, std::string label, Kind kind = Kind::User);
+
+    // Label of the longest matching prefix, or nullptr if none matches.
+    // ip in host order. An IPv4-mapped IPv6 address is looked up as IPv4.
+    const Label* classify(uint32_t ip) const;
+    const Label* classify(const in6_addr& ip) const;
+    // Dotted quad or IPv6 text; nullptr if it doesn't parse either
+    const Label* classify(std::string_view ip) const;
+
+private:
+    using Addr6 = std::pair<uint64_t, uint64_t>; // hi, lo
+
+    template <class K>
+    struct Prefix {
+        K net;
+        int len;
+        int label;
+    };
+
+    template <class K>
+    struct Table {
+        std::vector<Prefix<K>> prefixes; // as added
+        std::vector<K> starts;           // compiled: range i is [starts[i], starts[i+1])
+        std::vector<int> labels;         // label of range i, -1 if none
+        bool dirty = false;              // prefixes added since the last compile()
+
+        void compile();
+        int find(K key) const;
+    };
+
+    void compile() const; // whichever tables are dirty
+
+    std::vector<Label> labels_;
+    // compiled lazily by the first classify() that needs it
+    mutable Table<uint32_t> v4_;
+    mutable Table<Addr6> v6_;
+    mutable std::atomic<bool> dirty_{false};
+    mutable std::mutex compile_mu_;
+};
+
+} // namespace geo
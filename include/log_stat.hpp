@@ -0,0 +1,67 @@
+// ===================== File: include/log_stat.hpp =====================
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace geo::logstat {
+
+// RTT distribution in quarter-octave buckets (1 us .. ~70 s); mergeable and
+// fixed-size, so every worker keeps its own and they are summed at the end.
+class RttHist {
+public:
+    static constexpr int kBuckets = 112;
+
+    void add(double rtt_ms);
+    void merge(const RttHist& o);
+
+    uint64_t count() const { return n_; }
+    double min() const { return n_ ? min_ : 0.0; }
+    double max() const { return n_ ? max_ : 0.0; }
+    double mean() const { return n_ ? sum_ / static_cast<double>(n_) : 0.0; }
+    // Approximate q-quantile (0..1) in ms, good to one bucket (<25%)
+    double quantile(double q) const;
+
+private:
+    std::array<uint64_t, kBuckets> b_{};
+    uint64_t n_ = 0;
+    double sum_ = 0.0, min_ = 0.0, max_ = 0.0;
+};
+
+struct HopStats {
+    uint64_t sent = 0;        // PROBE_SENT lines
+    uint64_t send_errors = 0; // PROBE_SEND_ERR lines
+    uint64_t icmp = 0;        // matched ICMP_TIME_EXCEEDED
+    uint64_t dest = 0;        // DEST_REPLY (SYN-ACK or RST)
+    uint64_t silent = 0;      // NO_ICMP_THIS_HOP: hop with no reply at all
+    RttHist rtt;              // every matched reply at this TTL
+};
+
+// Totals over any number of diag logs (text format, as written by --log)
+struct LogStats {
+    std::array<HopStats, 256> hops{}; // indexed by TTL
+    uint64_t files = 0;
+    uint64_t bytes = 0;
+    uint64_t lines = 0;
+    uint64_t sessions = 0;       // "=== geo_tracer diag start" markers
+    uint64_t traces = 0;         // SETUP lines (one per target)
+    uint64_t reached = 0;        // STOP: destination reached
+    uint64_t unmatched_icmp = 0; // ICMP_TIME_EXCEEDED (unmatched)
+    uint64_t orphan_replies = 0; // replies whose sport had no PROBE_SENT
+    uint64_t nat_hits = 0;       // DIAG: only gateway + destination answered
+    uint64_t dropped_lines = 0;  // WARN diag ring overflow totals
+    uint64_t other = 0;          // lines of any other type
+    uint64_t malformed = 0;      // known type, unparsable fields
+
+    void merge(const LogStats& o);
+};
+
+// mmap `path` and fold every line into `st`. Returns false (with `err`) if
+// the file can't be opened or mapped.
+bool scan_file(const std::string& path, LogStats& st, std::string& err);
+
+// Same, over an in-memory buffer (one file's worth of lines)
+void scan_buffer(const char* data, std::size_t len, LogStats& st);
+
+} // namespace geo::logstat
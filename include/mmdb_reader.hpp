@@ -0,0 +1,54 @@
+// ===================== File: include/mmdb_reader.hpp =====================
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace geo {
+
+// MmdbReader: read-only MaxMind DB (GeoLite2/GeoIP2 City, Country or ASN)
+// lookups over an mmapped file. Nothing is parsed at load time beyond the
+// metadata map; a lookup walks the search tree and the data section in
+// place and hands back views into the mapping, so it never allocates.
+class MmdbReader {
+public:
+    // Fields we know how to pull out of the common MaxMind layouts; empty /
+    // zero when the database doesn't have them.
+    struct Record {
+        std::string_view city;        // city.names.en
+        std::string_view country;     // country.names.en (or registered_country)
+        std::string_view country_iso; // country.iso_code
+        std::string_view as_org;      // autonomous_system_organization
+        uint32_t asn = 0;             // autonomous_system_number
+        double lat = 0.0, lon = 0.0;  // location.latitude / longitude
+        bool has_location = false;
+    };
+
+    // Throws std::runtime_error if the file can't be mapped or isn't a
+    // MaxMind DB (v2) file.
+    explicit MmdbReader(const std::string& path);
+    ~MmdbReader();
+
+    MmdbReader(const MmdbReader&) = delete;
+    MmdbReader& operator=(const MmdbReader&) = delete;
+
+    // ip in host order. False if the address isn't in the database.
+    bool lookup(uint32_t ip, Record& out) const;
+
+    const std::string& database_type() const { return db_type_; }
+
+private:
+    uint32_t record(uint32_t node, int bit) const;
+
+    const uint8_t* base_ = nullptr;
+    std::size_t size_ = 0;
+    const uint8_t* data_ = nullptr; // data section
+    std::size_t data_size_ = 0;
+    uint32_t node_count_ = 0;
+    uint32_t record_size_ = 0;      // bits: 24, 28 or 32
+    uint32_t ipv4_start_ = 0;       // node reached after ::/96 in an IPv6 tree
+    std::string db_type_;
+};
+
+} // namespace geo
@@ -0,0 +1,29 @@
+// ===================== File: include/neighbor.hpp =====================
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string>
+#include <netinet/in.h>
+
+namespace geo {
+
+// Egress interface + Ethernet addresses for frames built by hand
+// (SendMode::Packet). Looked up once per destination.
+struct LinkInfo {
+    int ifindex = 0;
+    std::string ifname;
+    in_addr next_hop{};                // gateway, or the destination when on-link
+    std::array<uint8_t, 6> src_mac{};
+    std::array<uint8_t, 6> dst_mac{};
+
+    // 14-byte Ethernet header for IPv4 frames
+    std::array<uint8_t, 14> eth_header() const;
+};
+
+// Interface owning `src` (see find_local_ipv4_to), longest-prefix route
+// from /proc/net/route, neighbor MAC from /proc/net/arp. An unresolved
+// neighbor is poked with a UDP datagram and polled for up to ~1 s.
+// Throws std::runtime_error when any step fails or the route is loopback.
+LinkInfo resolve_link(const in_addr& dst, const in_addr& src);
+
+} // namespace geo
@@ -0,0 +1,111 @@
+// ===================== File: include/packet_ring.hpp =====================
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <linux/filter.h>
+#include <linux/if_packet.h>
+
+namespace geo {
+
+// PacketRing: AF_PACKET / TPACKET_V3 receive ring.
+//
+// An alternative to reading the raw ICMP and TCP sockets one datagram at a
+// time: the kernel fills mmapped blocks with every IPv4 packet that gets
+// past the attached BPF filter, and drain() walks each finished block in
+// place. Packets carry kernel receive timestamps, mapped onto the steady
+// clock the probes are stamped with. The fd turns readable when a block is
+// handed over (full, or after the 1 ms block timeout).
+class PacketRing {
+public:
+    PacketRing() = default;
+    ~PacketRing();
+
+    PacketRing(const PacketRing&) = delete;
+    PacketRing& operator=(const PacketRing&) = delete;
+
+    // false (errno set) if AF_PACKET or TPACKET_V3 isn't available
+    bool open(const std::vector<sock_filter>& filter);
+    void close();
+    int fd() const { return fd_; }
+
+    // on_packet(const uint8_t* ip, std::size_t len, steady_clock::time_point rx)
+    // for every packet in the blocks the kernel has handed over; the data
+    // is only valid during the call. Returns the packet count.
+    template <class F>
+    std::size_t drain(F&& on_packet);
+
+private:
+    tpacket_block_desc* ready_block() const;
+    void release_block();
+
+    int fd_ = -1;
+    uint8_t* map_ = nullptr;
+    std::size_t map_len_ = 0;
+    unsigned block_size_ = 0;
+    unsigned block_nr_ = 0;
+    unsigned cur_ = 0;
+};
+
+// PacketTxRing: AF_PACKET PACKET_TX_RING (TPACKET_V2) on one interface.
+//
+// push() copies a complete frame (link header + IP packet) into the next
+// free mmapped slot; kick() hands every queued frame to the driver with one
+// send() and waits until the kernel is done with them, so all slots are
+// free again afterwards.
+class PacketTxRing {
+public:
+    PacketTxRing() = default;
+    ~PacketTxRing();
+
+    PacketTxRing(const PacketTxRing&) = delete;
+    PacketTxRing& operator=(const PacketTxRing&) = delete;
+
+    // false (errno set) if AF_PACKET or the TX ring isn't available
+    bool open(int ifindex);
+    void close();
+    int fd() const { return fd_; }
+    int ifindex() const { return ifindex_; }
+
+    // false if every slot is still queued (kick() and retry)
+    bool push(const uint8_t* l2, std::size_t l2_len, const uint8_t* pkt, std::size_t len);
+
+    // 0, or -errno if the kernel refused the batch
+    int kick();
+
+private:
+    int fd_ = -1;
+    int ifindex_ = 0;
+    uint8_t* map_ = nullptr;
+    std::size_t map_len_ = 0;
+    unsigned frame_nr_ = 0;
+    unsigned cur_ = 0;
+};
+
+template <class F>
+std::size_t PacketRing::drain(F&& on_packet) {
+    using namespace std::chrono;
+    std::size_t n = 0;
+    while (tpacket_block_desc* bd = ready_block()) {
+        // kernel stamps are CLOCK_REALTIME; one offset per block is plenty
+        const auto sys_now = system_clock::now();
+        const auto steady_now = steady_clock::now();
+
+        auto* base = reinterpret_cast<uint8_t*>(bd);
+        auto* h = reinterpret_cast<tpacket3_hdr*>(base + bd->hdr.bh1.offset_to_first_pkt);
+        for (uint32_t i = 0; i < bd->hdr.bh1.num_pkts; ++i) {
+            const system_clock::time_point ts{duration_cast<system_clock::duration>(
+                seconds(h->tp_sec) + nanoseconds(h->tp_nsec))};
+            on_packet(reinterpret_cast<const uint8_t*>(h) + h->tp_net,
+                      static_cast<std::size_t>(h->tp_snaplen),
+                      steady_now - (sys_now - ts));
+            ++n;
+            h = reinterpret_cast<tpacket3_hdr*>(reinterpret_cast<uint8_t*>(h) + h->tp_next_offset);
+        }
+        release_block();
+    }
+    return n;
+}
+
+} // namespace geo
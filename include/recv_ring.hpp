@@ -0,0 +1,61 @@
+// ===================== File: include/recv_ring.hpp =====================
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+namespace geo {
+
+// Kernel timestamps. RX: SO_TIMESTAMPNS on a receive socket. TX: software
+// SO_TIMESTAMPING on a send socket; each sent packet comes back on its error
+// queue (drain with MSG_ERRQUEUE) carrying the time the driver took it.
+// false (errno set) if the kernel refused.
+bool enable_rx_timestamps(int fd);
+bool enable_tx_timestamps(int fd);
+
+// RecvRing: preallocated datagram slots drained with one recvmmsg().
+//
+// drain() never blocks; it fills as many slots as the socket has queued
+// (up to kSlots). received_at(i) is the kernel's timestamp for that
+// datagram when the socket has them turned on, mapped onto the steady
+// clock; otherwise it's the time the call returned, so replies that sat
+// behind each other don't each pick up the cost of handling the ones
+// before them.
+class RecvRing {
+public:
+    static constexpr int kSlots = 64;
+    static constexpr std::size_t kSlotSize = 2048;
+    static constexpr std::size_t kCtlSize = 256; // timestamp + extended error cmsgs
+
+    RecvRing();
+
+    RecvRing(const RecvRing&) = delete;
+    RecvRing& operator=(const RecvRing&) = delete;
+
+    // datagrams received, 0 if nothing was queued; flags are OR'ed into
+    // MSG_DONTWAIT (MSG_ERRQUEUE for TX timestamps)
+    int drain(int fd, int flags = 0);
+
+    const uint8_t* data(int i) const { return &buf_[static_cast<std::size_t>(i) * kSlotSize]; }
+    std::size_t len(int i) const { return msgs_[i].msg_len; }
+    const sockaddr_in& from(int i) const { return from_[i]; }
+    std::chrono::steady_clock::time_point received_at(int i) const;
+    bool kernel_stamped(int i) const;
+
+private:
+    const timespec* stamp(int i) const;
+
+    std::vector<uint8_t> buf_;
+    std::vector<uint8_t> ctl_;
+    std::vector<sockaddr_in> from_;
+    std::vector<iovec> iov_;
+    std::vector<mmsghdr> msgs_;
+    std::chrono::steady_clock::time_point at_{};
+    std::chrono::system_clock::time_point sys_at_{}; // same instant, for kernel stamps
+};
+
+} // namespace geo
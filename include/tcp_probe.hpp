@@ -1,5 +1,8 @@
 // ===================== File: include/tcp_probe.hpp =====================
 #pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <string>
 #include <vector>
 #include "diag_logger.hpp"
@@ -9,6 +12,7 @@ namespace geo {
     struct ProbeHopSummary {
         int ttl{};
         std::string hop_ip;
+        uint32_t hop_addr{};         // hop_ip, network order (0 if no reply)
         int num_replies{};
         double rtt_min_ms{};
         double rtt_avg_ms{};
@@ -16,14 +20,84 @@ namespace geo {
         bool reached{};
     };
 
-    enum class SendMode { Auto, Connect, Raw };
+    // Packet: same hand-built SYNs as Raw, but framed and written to an
+    // AF_PACKET TX ring on the egress interface (one neighbor lookup per target)
+    enum class SendMode { Auto, Connect, Raw, Packet };
+
+    // One destination for trace_many()
+    struct TraceTarget {
+        std::string host;
+        int port = 443;
+    };
+
+    // One finished hop, as soon as it and every lower TTL of its target are
+    // closed (so in TTL order per target). Runs on the probing thread.
+    using HopCallback = std::function<void(std::size_t target, const ProbeHopSummary&)>;
+
+    // Knobs shared by every target of a trace_many() batch
+    struct TraceOptions {
+        int max_hops = 30;
+        int timeout_ms = 1000;
+        SendMode mode = SendMode::Auto;
+        int ttl_window = 1;          // per target, same meaning as in trace()
+        int max_in_flight = 1024;    // probes outstanding across all targets
+        int probes_per_sec = 0;      // send pacing, 0 = unpaced
+        uint64_t seed = 0;           // sweep() probe order, 0 = pick one
+        bool rx_ring = false;        // AF_PACKET TPACKET_V3 ring instead of the reply sockets
+        DiagLogger* diag = nullptr;
+        HopCallback on_hop;          // optional, see HopCallback
+    };
+
+    // Per-target outcome, handed back as soon as that target is finished
+    struct TraceResult {
+        std::size_t index{};         // position in the targets vector
+        std::string dst_ip;          // empty if the host didn't resolve
+        std::string error;           // non-empty if the target was skipped
+        std::vector<ProbeHopSummary> hops;
+    };
+
+    using TraceCallback = std::function<void(TraceResult&&)>;
+
+    // One decoded reply from a stateless sweep()
+    struct SweepReply {
+        std::size_t target{};        // position in the targets vector
+        int ttl{};                   // TTL the probe left with
+        uint32_t hop_addr{};         // router (ICMP) or the destination itself, network order
+        double rtt_ms{};
+        bool reached{};              // SYN-ACK/RST from the destination
+    };
+
+    using SweepCallback = std::function<void(const SweepReply&)>;
 
     class TcpProbe {
     public:
+        // ttl_window: how many TTLs may be in flight at once.
+        //   1  -> classic hop-by-hop walk (default)
+        //   N  -> sliding window of N TTLs
+        //   <=0 -> every TTL up to max_hops is sent up front
+        // on_hop (target is always 0) sees each row of the result as soon
+        // as it is final, before trace() returns.
         static std::vector<ProbeHopSummary>
         trace(const std::string& host, int port, int max_hops = 30, int timeout_ms = 1000,
               SendMode mode = SendMode::Auto,
-              DiagLogger* diag = nullptr);
+              DiagLogger* diag = nullptr,
+              int ttl_window = 1,
+              const HopCallback& on_hop = nullptr);
+
+        // Trace many destinations over one set of sockets. At most
+        // opt.max_in_flight probes are outstanding at any time; on_done fires
+        // once per target (in completion order, not input order).
+        static void
+        trace_many(const std::vector<TraceTarget>& targets, const TraceOptions& opt,
+                   const TraceCallback& on_done);
+
+        // yarrp-style stateless sweep (raw or packet mode): one probe per
+        // (target, ttl) in a randomized order, with target/ttl/send time
+        // encoded in the probe itself, so no per-probe state is kept.
+        // Replies are reported as they arrive, duplicates included.
+        static void
+        sweep(const std::vector<TraceTarget>& targets, const TraceOptions& opt,
+              const SweepCallback& on_reply);
     };
 
 } // namespace geo
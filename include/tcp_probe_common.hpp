@@ -1,28 +1,149 @@
 #pragma once
 
 #include "dns_resolver.hpp"
+#include "timer_wheel.hpp"
+#include "packet_ring.hpp"
 
+#include <array>
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 
 namespace geo {
 
 using clk = std::chrono::steady_clock;
 
-// ProbeState: tracks per-probe TTL + send time
+// ProbeState: tracks per-probe target + TTL + send time (+ its deadline in the wheel)
+// Packed into 32 bytes so two share a cache line in the ProbeTable.
 struct ProbeState {
-    int ttl;
-    clk::time_point t0;
-    bool done = false;
-    ProbeState() = default;
-    ProbeState(int t, clk::time_point tp);
+    clk::time_point t0{};
+    TimerWheel::TimerId timer = TimerWheel::kInvalid;
+    uint32_t target = 0; // index into the batch; always 0 for a single trace
+    int32_t fd = -1;     // connect-mode socket, -1 for raw probes
+    uint8_t ttl = 0;
+    bool live = false;   // slot holds an in-flight probe
+    bool done = false;   // answered or timed out, waiting for its hop to close
 };
+static_assert(sizeof(ProbeState) <= 32, "ProbeState should stay two-per-cache-line");
 
-// HopAgg: aggregate stats for one hop
+// ProbeTable: in-flight probes indexed directly by source port. Allocated
+// once (64K slots) and reused across hops and traces, so matching a reply
+// is a single array load instead of a hash lookup.
+class ProbeTable {
+public:
+    ProbeTable();
+
+    ProbeState *find(uint16_t sport) {
+        ProbeState &ps = slots_[sport];
+        return ps.live ? &ps : nullptr;
+    }
+
+    ProbeState &insert(uint16_t sport, uint32_t target, int ttl, clk::time_point t0) {
+        ProbeState &ps = slots_[sport];
+        if (!ps.live)
+            live_++;
+        ps = ProbeState{};
+        ps.t0 = t0;
+        ps.target = target;
+        ps.ttl = static_cast<uint8_t>(ttl);
+        ps.live = true;
+        return ps;
+    }
+
+    void erase(uint16_t sport) {
+        ProbeState &ps = slots_[sport];
+        if (ps.live) {
+            ps.live = false;
+            live_--;
+        }
+    }
+
+    std::size_t size() const { return live_; }
+
+    // Close leftover connect sockets and empty the table (error paths only).
+    void clear();
+
+private:
+    std::vector<ProbeState> slots_;
+    std::size_t live_ = 0;
+};
+
+// TxLink: where one destination's frames go in SendMode::Packet
+struct TxLink {
+    PacketTxRing *ring = nullptr;
+    std::array<uint8_t, 14> eth{}; // LinkInfo::eth_header()
+};
+
+// SynTemplate: one target's IP+TCP SYN, built (and checksummed) once.
+// stamp() swaps in the per-probe fields (TTL, IP-ID, source port, seq),
+// patches both checksums incrementally (RFC 1624) and copies the result out.
+class SynTemplate {
+public:
+    static constexpr std::size_t kLen = 40; // iphdr + tcphdr, no options
+
+    SynTemplate() = default;
+    SynTemplate(const in_addr &src_ip, const in_addr &dst_ip, uint16_t dport);
+
+    void stamp(uint8_t *out, uint16_t sport, int ttl, uint16_t ip_id, uint32_t seq);
+
+private:
+    std::array<uint8_t, kLen> pkt_{};
+};
+
+// RawSynBatch: hand-built SYNs queued up and pushed to the IP_HDRINCL socket
+// with one sendmmsg(). Everything is preallocated; add() just fills a slot.
+class RawSynBatch {
+public:
+    static constexpr int kMaxMsgs = 64;
+    static constexpr std::size_t kSynLen = SynTemplate::kLen;
+
+    struct Meta {
+        uint32_t target = 0;
+        uint16_t sport = 0;
+        uint8_t ttl = 0;
+        uint8_t idx = 0;     // probe number within its hop
+        int result = 0;      // bytes sent, or -errno
+    };
+
+    RawSynBatch();
+
+    bool empty() const { return n_ == 0; }
+    bool full() const { return n_ == kMaxMsgs; }
+    int size() const { return n_; }
+    const Meta &meta(int i) const { return meta_[i]; }
+
+    void add(const sockaddr_in &dst, SynTemplate &syn,
+             uint16_t sport, int ttl, uint16_t ip_id, uint32_t seq,
+             uint32_t target, int idx);
+
+    // Submit everything queued; per-message outcome lands in meta(i).result.
+    // Returns the time taken right before the first sendmmsg() call.
+    clk::time_point flush(int raw_send_sock);
+
+    // Same, but framed and queued on TX rings (links indexed by meta.target),
+    // one kick per ring touched.
+    clk::time_point flush(const std::vector<TxLink> &links);
+
+    void clear() { n_ = 0; }
+
+private:
+    std::array<std::array<uint8_t, kSynLen>, kMaxMsgs> pkts_{};
+    std::array<sockaddr_in, kMaxMsgs> to_{};
+    std::array<iovec, kMaxMsgs> iov_{};
+    std::array<mmsghdr, kMaxMsgs> msgs_{};
+    std::array<Meta, kMaxMsgs> meta_{};
+    int n_ = 0;
+};
+
+// HopAgg: aggregate stats for one hop. The address stays an integer until
+// the hop is reported.
 struct HopAgg {
-    std::string ip;
+    uint32_t addr; // first responder (network order)
     int count;
     double min_ms, max_ms, sum_ms;
     bool reached;
@@ -0,0 +1,68 @@
+// ===================== File: include/timer_wheel.hpp =====================
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace geo {
+
+// TimerWheel: hierarchical timing wheel (4 levels x 64 slots, 1 tick = 1 ms).
+//
+// schedule/cancel are O(1); advancing costs O(1) per elapsed tick plus the
+// timers that actually fire or cascade. Good for ~4.6 hours of horizon,
+// anything later is parked in the top level and re-cascaded.
+//
+// Timers carry an opaque 64-bit token instead of a callback so the owner
+// decides what an expiry means (probe key, hop id, ...).
+class TimerWheel {
+public:
+    using clock   = std::chrono::steady_clock;
+    using TimerId = uint64_t; // slab index | generation << 32
+    static constexpr TimerId kInvalid = ~TimerId{0};
+
+    explicit TimerWheel(clock::time_point start = clock::now());
+
+    TimerId schedule(clock::time_point when, uint64_t token);
+    bool cancel(TimerId id);  // false if already fired/cancelled
+
+    // Fire everything due at or before `now`; tokens are appended to `expired`.
+    void advance(clock::time_point now, std::vector<uint64_t>& expired);
+
+    // Milliseconds until advance() may have work, -1 if the wheel is empty.
+    int ms_until_next(clock::time_point now) const;
+
+    std::size_t size() const { return live_; }
+    bool empty() const { return live_ == 0; }
+
+private:
+    static constexpr int kLevels   = 4;
+    static constexpr int kSlotBits = 6;
+    static constexpr int kSlots    = 1 << kSlotBits;
+    static constexpr uint32_t kNil = ~uint32_t{0};
+
+    struct Node {
+        uint64_t token;
+        uint64_t expiry; // absolute tick
+        uint32_t prev, next;
+        uint32_t gen;
+        uint16_t slot;   // level * kSlots + index, only meaningful while live
+        bool live;
+    };
+
+    uint64_t tick_of(clock::time_point tp) const;
+    void link(uint32_t idx);
+    void unlink(uint32_t idx);
+    void cascade(int level, int index);
+
+    clock::time_point start_;
+    uint64_t now_tick_ = 0; // last tick fully processed
+    std::size_t live_ = 0;
+
+    std::vector<Node> nodes_;
+    std::vector<uint32_t> free_;
+    std::array<uint32_t, kLevels * kSlots> heads_;
+};
+
+} // namespace geo
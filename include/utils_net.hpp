@@ -9,6 +9,27 @@ namespace geo::net {
 // Internet checksum over an arbitrary buffer
 uint16_t csum16(const void* data, std::size_t len);
 
+// Building blocks: add `data` to a running one's-complement sum (unfolded),
+// then fold + complement it into the final checksum.
+uint32_t csum_partial(const void* data, std::size_t len, uint32_t sum);
+uint16_t csum_fold(uint32_t sum);
+
+// Summing kernels behind csum_partial(). The widest one the CPU supports is
+// picked once at startup; all of them give bit-identical results.
+enum class CsumImpl { Scalar, Sse2, Avx2 };
+
+CsumImpl csum_active_impl();
+bool csum_impl_supported(CsumImpl impl);
+const char* csum_impl_name(CsumImpl impl);
+
+// csum_partial() with an explicit kernel (benchmarks / cross-checks).
+// Throws std::invalid_argument if the CPU can't run it.
+uint32_t csum_partial_impl(CsumImpl impl, const void* data, std::size_t len, uint32_t sum);
+
+// RFC 1624 incremental update: the 16-bit word `old_word` (as stored in the
+// packet) became `new_word`; returns the patched checksum.
+uint16_t csum_replace16(uint16_t check, uint16_t old_word, uint16_t new_word);
+
 // IPv4 header checksum (covers only the IP header)
 uint16_t ip_checksum(const iphdr* ip);
 
@@ -0,0 +1,103 @@
+/**
+ * # build the binary diag log decoder
+ * make diagdump   # alias: make geo_diagdump
+ * sudo ./bin/geo_trace google.com --mode=raw --log=diag.bin --log-format=binary
+ * ./bin/geo_diagdump diag.bin > diag.txt
+ *
+ * Prints each file exactly as --log-format=text would have written it.
+ * Reads stdin when no file (or "-") is given.
+ */
+// ===================== main_diagdump.cpp =====================
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "diag_event.hpp"
+
+using namespace std;
+using namespace geo;
+
+// Decode one record stream to stdout; false (with a message) on bad input.
+static bool dump(FILE *in, const char *name)
+{
+    diag::Timestamp stamp;
+    diag::NameTable names;
+    diag::Record r;
+    vector<char> payload;
+    string line;
+    unsigned long long n = 0;
+
+    for (;; ++n)
+    {
+        const size_t got = fread(&r, 1, sizeof(r), in);
+        if (got == 0)
+            return true;
+        if (got != sizeof(r))
+        {
+            cerr << name << ": truncated record #" << n << "\n";
+            return false;
+        }
+        if (r.type < static_cast<uint8_t>(diag::Event::LogStart) ||
+            r.type > static_cast<uint8_t>(diag::Event::SweepReply))
+        {
+            cerr << name << ": bad event type " << int(r.type) << " in record #" << n
+                 << " (not a binary diag log?)\n";
+            return false;
+        }
+        payload.resize(r.len);
+        if (r.len && fread(payload.data(), 1, r.len, in) != r.len)
+        {
+            cerr << name << ": truncated payload in record #" << n << "\n";
+            return false;
+        }
+
+        const char *ts = stamp.format(r.ts_ns);
+        switch (static_cast<diag::Event>(r.type))
+        {
+        case diag::Event::LogStart:
+            cout << "=== geo_tracer diag start " << ts << " ===\n";
+            continue;
+        case diag::Event::LogEnd:
+            cout << "=== geo_tracer diag end " << ts << " ===\n";
+            continue;
+        default:
+            break;
+        }
+        line.clear();
+        if (diag::render(line, r, payload.data(), names))
+            cout << ts << " | " << line << "\n";
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    ios::sync_with_stdio(false);
+
+    vector<string> files(argv + 1, argv + argc);
+    if (files.empty())
+        files.push_back("-");
+
+    int rc = 0;
+    for (const auto &f : files)
+    {
+        if (f == "-h" || f == "--help")
+        {
+            cout << "Usage: " << argv[0] << " [file.bin ...]   (reads stdin if none)\n";
+            return 0;
+        }
+        FILE *in = (f == "-") ? stdin : fopen(f.c_str(), "rb");
+        if (!in)
+        {
+            perror(f.c_str());
+            rc = 1;
+            continue;
+        }
+        if (!dump(in, f.c_str()))
+            rc = 1;
+        if (in != stdin)
+            fclose(in);
+    }
+    cout.flush();
+    return rc;
+}
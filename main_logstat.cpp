@@ -0,0 +1,140 @@
+/**
+ * # build the diag log analyzer
+ * make logstat   # alias: make geo_logstat
+ * ./bin/geo_logstat diag_usp.txt diag_raw.txt
+ * ./bin/geo_logstat -j 8 $(ls logs/diag_*.txt)
+ *
+ * Reads text diag logs (geo_trace --log=...; decode binary ones with
+ * geo_diagdump first), one file per worker thread, and prints per-TTL probe
+ * counts, loss, RTT percentiles and the NAT / unmatched-ICMP counters.
+ */
+// ===================== main_logstat.cpp =====================
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "log_stat.hpp"
+
+using namespace std;
+using namespace geo::logstat;
+
+static void print_usage(const char *argv0)
+{
+    cerr << "Usage: " << argv0 << " [-j N|--jobs=N] <diag_log.txt>...\n"
+         << "  -j N    worker threads (default: one per core)\n";
+}
+
+static void print_stats(const LogStats &st, double secs)
+{
+    const double mb = static_cast<double>(st.bytes) / (1024.0 * 1024.0);
+    cout << "Files: " << st.files << "  Lines: " << st.lines
+         << "  (" << fixed << setprecision(1) << mb << " MB in " << setprecision(3) << secs << " s";
+    if (secs > 0)
+        cout << ", " << setprecision(0) << mb / secs << " MB/s";
+    cout << ")\n";
+    cout << "Sessions: " << st.sessions << "  Traces: " << st.traces << "  Reached: " << st.reached << '\n';
+    cout << "Unmatched ICMP: " << st.unmatched_icmp
+         << "  Orphan replies: " << st.orphan_replies
+         << "  NAT heuristic hits: " << st.nat_hits
+         << "  Dropped lines: " << st.dropped_lines
+         << "  Malformed: " << st.malformed << '\n';
+
+    cout << '\n'
+         << setw(4) << "TTL" << setw(10) << "sent" << setw(10) << "replies" << setw(8) << "loss%"
+         << setw(8) << "silent" << setw(10) << "min" << setw(10) << "p50" << setw(10) << "p90"
+         << setw(10) << "p99" << setw(10) << "max" << "  (ms)\n";
+    for (size_t ttl = 1; ttl < st.hops.size(); ++ttl)
+    {
+        const HopStats &h = st.hops[ttl];
+        const uint64_t replies = h.icmp + h.dest;
+        if (h.sent == 0 && replies == 0 && h.silent == 0)
+            continue;
+        const double loss = h.sent ? 100.0 * (1.0 - min(1.0, double(replies) / double(h.sent))) : 0.0;
+        cout << setw(4) << ttl << setw(10) << h.sent << setw(10) << replies
+             << setw(8) << setprecision(1) << loss << setw(8) << h.silent << setprecision(3);
+        if (h.rtt.count())
+            cout << setw(10) << h.rtt.min() << setw(10) << h.rtt.quantile(0.5) << setw(10) << h.rtt.quantile(0.9)
+                 << setw(10) << h.rtt.quantile(0.99) << setw(10) << h.rtt.max();
+        else
+            cout << setw(10) << "*" << setw(10) << "*" << setw(10) << "*" << setw(10) << "*" << setw(10) << "*";
+        cout << '\n';
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    ios::sync_with_stdio(false);
+
+    vector<string> files;
+    unsigned jobs = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        string a = argv[i];
+        try
+        {
+            if (a == "-j" && i + 1 < argc)
+                jobs = static_cast<unsigned>(stoul(argv[++i]));
+            else if (a.rfind("--jobs=", 0) == 0)
+                jobs = static_cast<unsigned>(stoul(a.substr(7)));
+            else if (a == "-h" || a == "--help")
+            {
+                print_usage(argv[0]);
+                return 0;
+            }
+            else
+                files.push_back(a);
+        }
+        catch (const exception &)
+        {
+            cerr << "bad job count: " << a << "\n";
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (files.empty())
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (jobs == 0)
+        jobs = max(1u, thread::hardware_concurrency());
+    jobs = min<unsigned>(jobs, static_cast<unsigned>(files.size()));
+
+    // Workers pull whole files off a shared counter and keep private totals
+    const auto t0 = chrono::steady_clock::now();
+    vector<unique_ptr<LogStats>> part(jobs);
+    vector<string> errors(files.size());
+    atomic<size_t> next{0};
+    auto work = [&](unsigned w) {
+        part[w] = make_unique<LogStats>();
+        for (size_t i; (i = next.fetch_add(1, memory_order_relaxed)) < files.size();)
+            scan_file(files[i], *part[w], errors[i]);
+    };
+    vector<thread> pool;
+    for (unsigned w = 1; w < jobs; ++w)
+        pool.emplace_back(work, w);
+    work(0);
+    for (auto &t : pool)
+        t.join();
+
+    auto total = make_unique<LogStats>();
+    for (const auto &p : part)
+        total->merge(*p);
+    const double secs = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+
+    int rc = 0;
+    for (const auto &e : errors)
+        if (!e.empty())
+        {
+            cerr << "Error: " << e << '\n';
+            rc = 1;
+        }
+    print_stats(*total, secs);
+    return rc;
+}
@@ -13,19 +13,30 @@
  * Examples with options:
  *   sudo ./bin/geo_trace usp.ac.fj 443 30 2000 --mode=connect --log=diag_usp.txt
  *   sudo ./bin/geo_trace google.com --mode=raw --log=diag_raw.txt
+ *   sudo ./bin/geo_trace google.com --mode=raw --log=diag_raw.bin --log-format=binary
+ *   sudo ./bin/geo_trace google.com --mode=raw --parallel-ttl
+ *   sudo ./bin/geo_trace --targets=hosts.txt 443 30 1000 --mode=raw --rate=2000
+ *   sudo ./bin/geo_trace --targets=hosts.txt 443 30 2000 --stateless --rate=10000
  */
 
+#include <algorithm>
 #include <chrono>
 #include <cstring>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <mutex>
 #include <optional>
+#include <sstream>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <arpa/inet.h>
 
 #include "dns_resolver.hpp"
 #include "geo_resolver.hpp"
+#include "ip_prefix.hpp"
 #include "tcp_probe.hpp"
 #include "diag_logger.hpp"   // <-- added
 
@@ -34,27 +45,45 @@ using namespace geo;
 
 static void print_usage(const char *argv0) {
     cerr << "Usage:\n"
-         << "  " << argv0 << " <host> [port=443] [max_hops=30] [timeout_ms=1000] [--mode=auto|connect|raw] [--log=PATH]\n"
+         << "  " << argv0 << " <host> [port=443] [max_hops=30] [timeout_ms=1000] [--mode=auto|connect|raw|packet] [--log=PATH] [--parallel-ttl[=N]]\n"
+         << "  " << argv0 << " --targets=FILE [port=443] [max_hops=30] [timeout_ms=1000] [--rate=PPS] [--max-in-flight=N] [--stateless [--seed=N]] [--rx-ring] [...]\n"
          << "\nNotes:\n"
          << "  - Raw ICMP receive is required (needs sudo or CAP_NET_RAW).\n"
          << "  - --mode=connect mirrors traceroute -T and is NAT-friendly.\n"
-         << "  - --mode=raw sends SYN via IP_HDRINCL (may fail behind NAT/VM).\n";
+         << "  - --mode=raw sends SYN via IP_HDRINCL (may fail behind NAT/VM).\n"
+         << "  - --mode=packet sends the same SYNs as Ethernet frames through an AF_PACKET TX ring.\n"
+         << "  - --parallel-ttl sends every TTL up front (or N at a time) instead of hop-by-hop.\n"
+         << "  - --targets traces every \"host [port]\" line of FILE over one socket set.\n"
+         << "  - --stateless sends one raw probe per (target, ttl) in random order and prints replies as they come.\n"
+         << "  - --rx-ring reads replies from an AF_PACKET mmap ring (with --targets or --stateless).\n"
+         << "  - --log-async hands --log lines to a background writer instead of writing them inline.\n"
+         << "  - --geo-ttl=SEC caches geo lookups per hop IP for SEC seconds (0: nothing kept in memory; --geo-cache still applies).\n"
+         << "  - --geo-db=PATH resolves hops from a local MaxMind DB (City/ASN, repeatable); ip-api covers the rest.\n"
+         << "  - --geo-cache=PATH keeps geo lookups in a file shared across runs (created if missing).\n"
+         << "  - --local-prefix=CIDR[,LABEL] labels hops in CIDR locally (default \"Local Router\") and skips their lookup (repeatable).\n"
+         << "  - --prefix-labels describes hops in special-purpose space by their IANA registry name.\n"
+         << "  - --log-format=binary writes compact typed records instead of text (decode with geo_diagdump).\n";
 }
 
 // ---- helpers for pretty output ----
-static bool is_private_ipv4(const string &ip) {
-    in_addr a{}; if (inet_pton(AF_INET, ip.c_str(), &a) != 1) return false;
-    uint32_t x = ntohl(a.s_addr);
-    if ((x & 0xFF000000) == 0x0A000000) return true;        // 10.0.0.0/8
-    if ((x & 0xFFF00000) == 0xAC100000) return true;        // 172.16.0.0/12
-    if ((x & 0xFFFF0000) == 0xC0A80000) return true;        // 192.168.0.0/16
-    if ((x & 0xFFC00000) == 0x64400000) return true;        // 100.64.0.0/10 (CGNAT)
-    if ((x & 0xFFFF0000) == 0xA9FE0000) return true;        // 169.254.0.0/16 (link-local)
-    return false;
+
+// --prefix-labels: name special-purpose hops by their registry entry
+static bool show_prefix_labels = false;
+
+// IANA special-purpose space plus any --local-prefix entries; hops in it
+// are never sent for a geo lookup
+static const PrefixClassifier::Label *local_label(const ProbeHopSummary &h) {
+    if (h.num_replies == 0) return nullptr;
+    return GeoResolver::local_prefix(static_cast<uint32_t>(ntohl(h.hop_addr)));
 }
 
-static string make_desc(const optional<GeoInfo> &g, const string &ip) {
-    if (is_private_ipv4(ip)) return "Local Router";
+static string make_desc(const optional<GeoInfo> &g, const PrefixClassifier::Label *local) {
+    if (local) {
+        if (show_prefix_labels || local->kind == PrefixClassifier::Kind::User) return local->name;
+        // private, CGNAT, link-local; anything else reserved is what ip-api
+        // would have answered "fail" for
+        return local->kind == PrefixClassifier::Kind::Local ? "Local Router" : "Unknown location";
+    }
     if (!g) return "Unknown location";
     string loc;
     if (!g->city.empty() && !g->country.empty()) loc = g->city + ", " + g->country;
@@ -82,10 +111,105 @@ static string pick_dest_ipv4(const string &host, int port) {
     return string{};
 }
 
+using GeoMap = unordered_map<string, optional<GeoInfo>>;
+
+// Only public hops need a lookup
+static bool needs_geo(const ProbeHopSummary &h) {
+    return h.num_replies > 0 && !h.hop_ip.empty() && !local_label(h);
+}
+
+static void print_hop(const ProbeHopSummary &h, const optional<GeoInfo> &g) {
+    if (h.num_replies == 0) {
+        cout << "Hop " << h.ttl
+             << ": * (no reply) - min/avg/max RTT = * / * / * ms\n";
+        return;
+    }
+    cout << "Hop " << h.ttl << ": " << h.hop_ip
+         << " (" << make_desc(g, local_label(h)) << ") - min/avg/max RTT = "
+         << fixed << setprecision(2)
+         << h.rtt_min_ms << " / " << h.rtt_avg_ms << " / " << h.rtt_max_ms << " ms\n";
+}
+
+static void print_total(const vector<ProbeHopSummary> &hops) {
+    int reached_hop = -1;
+    for (const auto &h : hops)
+        if (h.num_replies > 0 && h.reached) { reached_hop = h.ttl; break; }
+
+    cout << string(43, '-') << '\n';
+    if (reached_hop != -1) cout << "Total hops: " << reached_hop << '\n';
+    else if (!hops.empty()) cout << "Total hops: " << hops.back().ttl << " (destination not reached)\n";
+}
+
+static void print_hops(const vector<ProbeHopSummary> &hops, const GeoMap &geo) {
+    for (const auto &h : hops) {
+        optional<GeoInfo> g;
+        if (auto it = geo.find(h.hop_ip); it != geo.end()) g = it->second;
+        print_hop(h, g);
+    }
+    print_total(hops);
+}
+
+// Streams a single trace: hops arrive from the probe thread in ttl order,
+// geo answers from the lookup workers, and each line is printed as soon as
+// it has both (and every line above it is out).
+class HopPrinter {
+public:
+    void hop(const ProbeHopSummary &h) {
+        lock_guard<mutex> lk(mu_);
+        rows_.push_back(h);
+        flush();
+    }
+
+    void geo(const string &ip, const optional<GeoInfo> &g) {
+        lock_guard<mutex> lk(mu_);
+        geo_[ip] = g;
+        flush();
+    }
+
+private:
+    void flush() {
+        for (; printed_ < rows_.size(); ++printed_) {
+            const ProbeHopSummary &h = rows_[printed_];
+            optional<GeoInfo> g;
+            if (needs_geo(h)) {
+                auto it = geo_.find(h.hop_ip);
+                if (it == geo_.end()) break;
+                g = it->second;
+            }
+            print_hop(h, g);
+        }
+        cout.flush();
+    }
+
+    mutex mu_;
+    vector<ProbeHopSummary> rows_;
+    size_t printed_ = 0;
+    GeoMap geo_;
+};
+
+// targets file: one "host [port]" per line, '#' starts a comment
+static vector<TraceTarget> read_targets(const string &path, int default_port) {
+    ifstream in(path);
+    if (!in) throw runtime_error("couldn't open targets file: " + path);
+    vector<TraceTarget> out;
+    string line;
+    while (getline(in, line)) {
+        line = line.substr(0, line.find('#'));
+        istringstream ls(line);
+        TraceTarget t;
+        t.port = default_port;
+        if (!(ls >> t.host)) continue;
+        ls >> t.port;
+        out.push_back(t);
+    }
+    return out;
+}
+
 static SendMode parse_mode(const string& s) {
     if (s == "auto")    return SendMode::Auto;
     if (s == "connect") return SendMode::Connect;
     if (s == "raw")     return SendMode::Raw;
+    if (s == "packet")  return SendMode::Packet;
     throw invalid_argument("bad mode: " + s);
 }
 
@@ -96,10 +220,25 @@ int main(int argc, char *argv[]) {
 
     // Parse flags in any position:
     //   positional: <host> [port] [max_hops] [timeout_ms]
-    //   flags: --mode=auto|connect|raw , --log=PATH
+    //   flags: --mode=auto|connect|raw|packet , --log=PATH , --parallel-ttl[=N]
+    //   batch: --targets=FILE (no <host>), --rate=PPS , --max-in-flight=N ,
+    //          --stateless , --seed=N , --rx-ring
+    //   logging: --log-async , --log-format=text|binary
+    //   geo: --geo-ttl=SEC , --geo-cache=PATH , --geo-db=PATH (repeatable)
+    //        --local-prefix=CIDR[,LABEL] (repeatable) , --prefix-labels
     vector<string> pos;
     string log_path;
+    string targets_path;
     SendMode mode = SendMode::Auto;
+    int ttl_window = 1;
+    int rate = 0;
+    int max_in_flight = 1024;
+    bool stateless = false;
+    bool rx_ring = false;
+    DiagLogger::Mode log_mode = DiagLogger::Mode::Sync;
+    DiagLogger::Format log_format = DiagLogger::Format::Text;
+    uint64_t seed = 0;
+    string geo_cache_path;
 
     for (int i = 1; i < argc; ++i) {
         string a = argv[i];
@@ -108,11 +247,71 @@ int main(int argc, char *argv[]) {
             catch (const exception& e) { cerr << e.what() << "\n"; print_usage(argv[0]); return 1; }
         } else if (a.rfind("--log=", 0) == 0) {
             log_path = a.substr(6);
+        } else if (a == "--parallel-ttl") {
+            ttl_window = 0;
+        } else if (a.rfind("--parallel-ttl=", 0) == 0) {
+            try { ttl_window = stoi(a.substr(15)); }
+            catch (const exception&) { cerr << "bad window: " << a << "\n"; print_usage(argv[0]); return 1; }
+        } else if (a.rfind("--targets=", 0) == 0) {
+            targets_path = a.substr(10);
+        } else if (a.rfind("--rate=", 0) == 0) {
+            try { rate = stoi(a.substr(7)); }
+            catch (const exception&) { cerr << "bad rate: " << a << "\n"; print_usage(argv[0]); return 1; }
+        } else if (a.rfind("--max-in-flight=", 0) == 0) {
+            try { max_in_flight = stoi(a.substr(16)); }
+            catch (const exception&) { cerr << "bad in-flight limit: " << a << "\n"; print_usage(argv[0]); return 1; }
+        } else if (a == "--stateless") {
+            stateless = true;
+        } else if (a == "--rx-ring") {
+            rx_ring = true;
+        } else if (a == "--log-async") {
+            log_mode = DiagLogger::Mode::Async;
+        } else if (a.rfind("--log-format=", 0) == 0) {
+            const string f = a.substr(13);
+            if (f == "text") log_format = DiagLogger::Format::Text;
+            else if (f == "binary") log_format = DiagLogger::Format::Binary;
+            else { cerr << "bad log format: " << a << "\n"; print_usage(argv[0]); return 1; }
+        } else if (a.rfind("--geo-ttl=", 0) == 0) {
+            try {
+                const chrono::seconds ttl(stoi(a.substr(10)));
+                GeoCacheConfig gc;
+                if (ttl.count() > 0) {
+                    gc.ttl = ttl;
+                    gc.negative_ttl = min(gc.negative_ttl, ttl);
+                } else {
+                    gc.capacity = 0; // --geo-cache entries keep the default TTLs
+                }
+                GeoResolver::configure_cache(gc);
+            }
+            catch (const exception&) { cerr << "bad geo ttl: " << a << "\n"; print_usage(argv[0]); return 1; }
+        } else if (a.rfind("--geo-db=", 0) == 0) {
+            try { GeoResolver::use_offline_db(a.substr(9)); }
+            catch (const exception& e) { cerr << "Warning: " << e.what() << "\n"; }
+        } else if (a.rfind("--local-prefix=", 0) == 0) {
+            const string v = a.substr(15);
+            const size_t comma = v.find(',');
+            try { GeoResolver::add_local_prefix(v.substr(0, comma), comma == string::npos ? "Local Router" : v.substr(comma + 1)); }
+            catch (const exception& e) { cerr << e.what() << "\n"; print_usage(argv[0]); return 1; }
+        } else if (a == "--prefix-labels") {
+            show_prefix_labels = true;
+        } else if (a.rfind("--geo-cache=", 0) == 0) {
+            geo_cache_path = a.substr(12);
+        } else if (a.rfind("--seed=", 0) == 0) {
+            try { seed = stoull(a.substr(7)); }
+            catch (const exception&) { cerr << "bad seed: " << a << "\n"; print_usage(argv[0]); return 1; }
         } else {
             pos.push_back(a);
         }
     }
 
+    // shared on-disk geo cache (a failure just means running without it)
+    if (!geo_cache_path.empty()) {
+        try { GeoResolver::use_disk_cache(geo_cache_path); }
+        catch (const exception& e) { cerr << "Warning: " << e.what() << "\n"; }
+    }
+
+    // batch mode has no <host>; shift the rest of the positionals
+    if (!targets_path.empty()) pos.insert(pos.begin(), string{});
     if (pos.empty()) { print_usage(argv[0]); return 1; }
 
     const string host      = pos[0];
@@ -120,45 +319,124 @@ int main(int argc, char *argv[]) {
     const int    max_hops  = (pos.size() >= 3 ? stoi(pos[2]) : 30);
     const int    timeout_ms= (pos.size() >= 4 ? stoi(pos[3]) : 1000);
 
+    if (stateless) {
+        try {
+            vector<TraceTarget> targets = targets_path.empty()
+                ? vector<TraceTarget>{TraceTarget{host, port}}
+                : read_targets(targets_path, port);
+
+            DiagLogger diag(log_path, log_mode, log_format);
+            DiagLogger* dptr = (diag.ok() && !log_path.empty()) ? &diag : nullptr;
+            if (!log_path.empty() && !diag.ok()) {
+                cerr << "Warning: couldn't open log file: " << log_path << "\n";
+            }
+
+            TraceOptions opt;
+            opt.max_hops = max_hops;
+            opt.timeout_ms = timeout_ms;
+            opt.mode = mode == SendMode::Packet ? SendMode::Packet : SendMode::Raw;
+            opt.probes_per_sec = rate;
+            opt.seed = seed;
+            opt.rx_ring = rx_ring;
+            opt.diag = dptr;
+
+            size_t n = 0;
+            TcpProbe::sweep(targets, opt, [&](const SweepReply &r) {
+                n++;
+                char hop[INET_ADDRSTRLEN];
+                in_addr a{};
+                a.s_addr = r.hop_addr;
+                inet_ntop(AF_INET, &a, hop, sizeof(hop));
+                cout << targets[r.target].host << " ttl=" << r.ttl << " " << hop
+                     << " " << fixed << setprecision(2) << r.rtt_ms << " ms"
+                     << (r.reached ? " (destination)" : "") << '\n';
+            });
+            cout << string(43, '-') << '\n' << "Replies: " << n << '\n';
+            return 0;
+        } catch (const exception &e) {
+            cerr << "Error: " << e.what() << '\n';
+            return 1;
+        }
+    }
+
+    if (!targets_path.empty()) {
+        try {
+            auto targets = read_targets(targets_path, port);
+
+            DiagLogger diag(log_path, log_mode, log_format);
+            DiagLogger* dptr = (diag.ok() && !log_path.empty()) ? &diag : nullptr;
+            if (!log_path.empty() && !diag.ok()) {
+                cerr << "Warning: couldn't open log file: " << log_path << "\n";
+            }
+
+            TraceOptions opt;
+            opt.max_hops = max_hops;
+            opt.timeout_ms = timeout_ms;
+            opt.mode = mode;
+            opt.ttl_window = ttl_window;
+            opt.max_in_flight = max_in_flight;
+            opt.probes_per_sec = rate;
+            opt.rx_ring = rx_ring;
+            opt.diag = dptr;
+
+            // geo lookups start as hops come in, on the lookup workers, so
+            // they overlap with the rest of the batch instead of following it
+            GeoMap geo;
+            mutex geo_mu;
+            unordered_set<string> asked;
+            GeoLookupQueue geoq([&](const string &ip, const optional<GeoInfo> &g) {
+                lock_guard<mutex> lk(geo_mu);
+                geo[ip] = g;
+            });
+            opt.on_hop = [&](size_t, const ProbeHopSummary &h) {
+                if (needs_geo(h) && asked.insert(h.hop_ip).second) geoq.submit(h.hop_ip);
+            };
+
+            vector<TraceResult> results;
+            TcpProbe::trace_many(targets, opt, [&](TraceResult &&r) { results.push_back(std::move(r)); });
+            geoq.wait();
+
+            for (const auto &r : results) {
+                const string &name = targets[r.index].host;
+                if (!r.error.empty()) {
+                    cerr << "[" << name << "] Error: " << r.error << '\n';
+                    continue;
+                }
+                cout << "[Destination - " << r.dst_ip << "] " << name << '\n';
+                print_hops(r.hops, geo);
+                cout << '\n';
+            }
+            return 0;
+        } catch (const exception &e) {
+            cerr << "Error: " << e.what() << '\n';
+            return 1;
+        }
+    }
+
     try {
         // Show destination IPv4
         string dst_ip = pick_dest_ipv4(host, port);
         if (!dst_ip.empty()) cout << "[Destination - " << dst_ip << "]\n";
 
         // Optional diagnostics
-        DiagLogger diag(log_path);
+        DiagLogger diag(log_path, log_mode, log_format);
         DiagLogger* dptr = (diag.ok() && !log_path.empty()) ? &diag : nullptr;
         if (!log_path.empty() && !diag.ok()) {
             cerr << "Warning: couldn't open log file: " << log_path << "\n";
         }
 
-        // Trace with mode + diagnostics
-        auto hops = TcpProbe::trace(host, port, max_hops, timeout_ms, mode, dptr);
-
-        int reached_hop = -1;
-        for (const auto &h : hops) {
-            if (h.num_replies == 0) {
-                cout << "Hop " << h.ttl
-                     << ": * (no reply) - min/avg/max RTT = * / * / * ms\n";
-                continue;
-            }
-
-            string ip = h.hop_ip;
-            optional<GeoInfo> g;
-            if (!ip.empty()) g = GeoResolver::lookup(ip);
-            string desc = make_desc(g, ip);
-
-            cout << "Hop " << h.ttl << ": " << ip
-                 << " (" << desc << ") - min/avg/max RTT = "
-                 << fixed << setprecision(2)
-                 << h.rtt_min_ms << " / " << h.rtt_avg_ms << " / " << h.rtt_max_ms << " ms\n";
-
-            if (h.reached && reached_hop == -1) reached_hop = h.ttl;
-        }
-
-        cout << string(43, '-') << '\n';
-        if (reached_hop != -1) cout << "Total hops: " << reached_hop << '\n';
-        else if (!hops.empty()) cout << "Total hops: " << hops.back().ttl << " (destination not reached)\n";
+        // Trace with mode + diagnostics; each hop's geo lookup starts as soon
+        // as the hop is known and its line prints once both are in
+        HopPrinter printer;
+        unordered_set<string> asked;
+        GeoLookupQueue geoq([&](const string &ip, const optional<GeoInfo> &g) { printer.geo(ip, g); });
+        auto hops = TcpProbe::trace(host, port, max_hops, timeout_ms, mode, dptr, ttl_window,
+                                    [&](size_t, const ProbeHopSummary &h) {
+                                        if (needs_geo(h) && asked.insert(h.hop_ip).second) geoq.submit(h.hop_ip);
+                                        printer.hop(h);
+                                    });
+        geoq.wait();
+        print_total(hops);
 
         return 0;
     } catch (const exception &e) {
@@ -0,0 +1,164 @@
+#include "bpf_filter.hpp"
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <arpa/inet.h> // ntohl
+#include <netinet/in.h>
+#include <linux/if_packet.h>
+#include <sys/socket.h>
+
+namespace geo::bpf {
+
+namespace {
+
+// Both programs start at the IP header (raw sockets hand us the whole
+// datagram). BPF_LD loads are big-endian, so addresses are compared in
+// host order.
+constexpr uint32_t kAcceptLen = 0xFFFF;
+constexpr uint8_t kTcpFlagsSynAck = 0x12;
+constexpr uint8_t kTcpFlagRst = 0x04;
+constexpr uint8_t kIcmpTimeExceeded = 11;
+
+// Tiny assembler: jumps name labels, offsets are patched in finish().
+class Program {
+public:
+    enum Label { kNext = -1, kAccept, kReject, kFlagsOk, kAddrOk, kLabels };
+
+    void stmt(uint16_t code, uint32_t k) { code_.push_back(BPF_STMT(code, k)); }
+
+    void jump(uint16_t code, uint32_t k, int jt, int jf) {
+        fix_.push_back({code_.size(), jt, jf});
+        code_.push_back(BPF_JUMP(code, k, 0, 0));
+    }
+
+    void bind(Label l) { pos_[l] = code_.size(); }
+
+    std::vector<sock_filter> finish() {
+        bind(kAccept);
+        stmt(BPF_RET | BPF_K, kAcceptLen);
+        bind(kReject);
+        stmt(BPF_RET | BPF_K, 0);
+        for (const auto& f : fix_) {
+            code_[f.at].jt = offset(f.at, f.jt);
+            code_[f.at].jf = offset(f.at, f.jf);
+        }
+        return std::move(code_);
+    }
+
+private:
+    struct Fixup {
+        std::size_t at;
+        int jt, jf;
+    };
+
+    uint8_t offset(std::size_t at, int label) const {
+        if (label == kNext)
+            return 0;
+        std::size_t d = pos_[label] - at - 1;
+        if (d > 0xFF)
+            throw std::logic_error("bpf: jump out of range");
+        return static_cast<uint8_t>(d);
+    }
+
+    std::vector<sock_filter> code_;
+    std::vector<Fixup> fix_;
+    std::array<std::size_t, kLabels> pos_{};
+};
+
+// A already holds the address; fall through on a match, reject otherwise
+void match_addrs(Program& p, const std::vector<uint32_t>& dsts) {
+    if (dsts.empty() || dsts.size() > kMaxAddrs)
+        return;
+    std::vector<uint32_t> host(dsts.size());
+    std::transform(dsts.begin(), dsts.end(), host.begin(), [](uint32_t a) { return ntohl(a); });
+    std::sort(host.begin(), host.end());
+    host.erase(std::unique(host.begin(), host.end()), host.end());
+
+    for (std::size_t i = 0; i < host.size(); ++i) {
+        bool last = i + 1 == host.size();
+        p.jump(BPF_JMP | BPF_JEQ | BPF_K, host[i], Program::kAddrOk, last ? Program::kReject : Program::kNext);
+    }
+    p.bind(Program::kAddrOk);
+}
+
+// A holds the port
+void match_ports(Program& p, PortRange ports) {
+    p.jump(BPF_JMP | BPF_JGE | BPF_K, ports.lo, Program::kNext, Program::kReject);
+    p.jump(BPF_JMP | BPF_JGT | BPF_K, ports.hi, Program::kReject, Program::kAccept);
+}
+
+} // namespace
+
+std::vector<sock_filter> tcp_reply_filter(const std::vector<uint32_t>& dsts, PortRange ports) {
+    Program p;
+    // not a first fragment -> no TCP header to look at
+    p.stmt(BPF_LD | BPF_H | BPF_ABS, 6);
+    p.jump(BPF_JMP | BPF_JSET | BPF_K, 0x1FFF, Program::kReject, Program::kNext);
+    p.stmt(BPF_LDX | BPF_B | BPF_MSH, 0); // X = IP header length
+
+    // SYN+ACK or RST
+    p.stmt(BPF_LD | BPF_B | BPF_IND, 13);
+    p.jump(BPF_JMP | BPF_JSET | BPF_K, kTcpFlagRst, Program::kFlagsOk, Program::kNext);
+    p.stmt(BPF_ALU | BPF_AND | BPF_K, kTcpFlagsSynAck);
+    p.jump(BPF_JMP | BPF_JEQ | BPF_K, kTcpFlagsSynAck, Program::kNext, Program::kReject);
+
+    // from one of the targets, to one of our ports
+    p.bind(Program::kFlagsOk);
+    p.stmt(BPF_LD | BPF_W | BPF_ABS, 12);
+    match_addrs(p, dsts);
+    p.stmt(BPF_LD | BPF_H | BPF_IND, 2);
+    match_ports(p, ports);
+    return p.finish();
+}
+
+std::vector<sock_filter> icmp_time_exceeded_filter(const std::vector<uint32_t>& dsts, PortRange ports) {
+    Program p;
+    p.stmt(BPF_LDX | BPF_B | BPF_MSH, 0); // X = outer IP header length
+
+    p.stmt(BPF_LD | BPF_B | BPF_IND, 0); // ICMP type
+    p.jump(BPF_JMP | BPF_JEQ | BPF_K, kIcmpTimeExceeded, Program::kNext, Program::kReject);
+
+    // quoted datagram starts 8 bytes into the ICMP message
+    p.stmt(BPF_LD | BPF_B | BPF_IND, 8 + 9); // inner protocol
+    p.jump(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_TCP, Program::kNext, Program::kReject);
+    p.stmt(BPF_LD | BPF_W | BPF_IND, 8 + 16); // inner destination
+    match_addrs(p, dsts);
+
+    // X += inner IP header length, then the quoted TCP source port
+    p.stmt(BPF_LD | BPF_B | BPF_IND, 8);
+    p.stmt(BPF_ALU | BPF_AND | BPF_K, 0x0F);
+    p.stmt(BPF_ALU | BPF_LSH | BPF_K, 2);
+    p.stmt(BPF_ALU | BPF_ADD | BPF_X, 0);
+    p.stmt(BPF_MISC | BPF_TAX, 0);
+    p.stmt(BPF_LD | BPF_H | BPF_IND, 8);
+    match_ports(p, ports);
+    return p.finish();
+}
+
+std::vector<sock_filter> reply_filter(const std::vector<uint32_t>& dsts, PortRange ports) {
+    auto icmp = icmp_time_exceeded_filter(dsts, ports);
+    auto tcp = tcp_reply_filter(dsts, ports);
+
+    std::vector<sock_filter> code = {
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, static_cast<uint32_t>(SKF_AD_OFF + SKF_AD_PKTTYPE)),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, PACKET_OUTGOING, 4, 0),
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 9), // IP protocol
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_TCP, 0, 1),
+        BPF_JUMP(BPF_JMP | BPF_JA, static_cast<uint32_t>(icmp.size() + 2), 0, 0),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_ICMP, 1, 0),
+        BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+    // both programs only jump forward within themselves, so they splice as-is
+    code.insert(code.end(), icmp.begin(), icmp.end());
+    code.insert(code.end(), tcp.begin(), tcp.end());
+    return code;
+}
+
+bool attach(int fd, const std::vector<sock_filter>& prog) {
+    sock_fprog fp{};
+    fp.len = static_cast<unsigned short>(prog.size());
+    fp.filter = const_cast<sock_filter*>(prog.data());
+    return ::setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &fp, sizeof(fp)) == 0;
+}
+
+} // namespace geo::bpf
@@ -0,0 +1,174 @@
+// ===================== File: src/diag_event.cpp =====================
+#include "diag_event.hpp"
+
+#include <arpa/inet.h>
+#include <cstring>
+#include <ctime>
+#include <netinet/in.h>
+
+namespace geo::diag {
+
+namespace {
+const std::string kEmpty;
+
+const char* probe_kind_name(uint8_t k) {
+    switch (static_cast<ProbeKind>(k)) {
+    case ProbeKind::Raw:     return "raw";
+    case ProbeKind::Packet:  return "packet";
+    case ProbeKind::Connect: return "connect";
+    case ProbeKind::Sweep:   return "sweep";
+    }
+    return "?";
+}
+
+const char* reply_kind_name(uint8_t k) {
+    switch (static_cast<ReplyKind>(k)) {
+    case ReplyKind::Icmp:   return "ICMP";
+    case ReplyKind::SynAck: return "SYN-ACK";
+    case ReplyKind::Rst:    return "RST";
+    }
+    return "?";
+}
+
+void append_addr(std::string& out, uint32_t be_ip) {
+    in_addr a;
+    a.s_addr = be_ip;
+    char buf[INET_ADDRSTRLEN];
+    if (inet_ntop(AF_INET, &a, buf, sizeof(buf)))
+        out += buf;
+}
+
+// same digits std::to_string(double ms) always gave us
+void append_ms(std::string& out, int64_t ns) {
+    out += std::to_string(static_cast<double>(ns) / 1e6);
+}
+} // namespace
+
+void NameTable::set(uint32_t target, const char* name, std::size_t len, bool tag_lines) {
+    if (target >= names_.size()) {
+        names_.resize(target + 1);
+        tags_.resize(target + 1);
+    }
+    names_[target].assign(name, len);
+    tags_[target] = tag_lines ? "[" + names_[target] + "] " : std::string();
+}
+
+const std::string& NameTable::name(uint32_t target) const {
+    return target < names_.size() ? names_[target] : kEmpty;
+}
+
+const std::string& NameTable::tag(uint32_t target) const {
+    return target < tags_.size() ? tags_[target] : kEmpty;
+}
+
+bool render(std::string& out, const Record& r, const char* payload, NameTable& names) {
+    const auto ttl = std::to_string(r.ttl);
+    switch (static_cast<Event>(r.type)) {
+    case Event::LogStart:
+    case Event::LogEnd:
+        return false;
+    case Event::TargetName:
+        names.set(r.target, payload, r.len, r.kind != 0);
+        return false;
+    case Event::Text:
+        out.append(payload, r.len);
+        break;
+    case Event::ProbeSent:
+        out += "PROBE_SENT mode=";
+        out += probe_kind_name(r.kind);
+        out += " ttl=" + ttl + " idx=" + std::to_string(r.idx) + " sport=" + std::to_string(r.sport);
+        if (static_cast<ProbeKind>(r.kind) != ProbeKind::Connect)
+            out += " bytes=" + std::to_string(r.value);
+        break;
+    case Event::ProbeSendErr:
+        out += "PROBE_SEND_ERR mode=";
+        out += probe_kind_name(r.kind);
+        out += " ttl=" + ttl;
+        if (static_cast<ProbeKind>(r.kind) == ProbeKind::Sweep)
+            out += " target=" + names.name(r.target);
+        else
+            out += " idx=" + std::to_string(r.idx) + " sport=" + std::to_string(r.sport);
+        out += " errno=" + std::to_string(r.value) + " (" + std::strerror(static_cast<int>(r.value)) + ")";
+        break;
+    case Event::HopSend:
+        out += names.tag(r.target) + "HOP " + ttl + ": send " + std::to_string(r.value) + " probes";
+        break;
+    case Event::IcmpTimeExceeded:
+        out += names.tag(r.target) + "ICMP_TIME_EXCEEDED from=";
+        append_addr(out, r.addr);
+        out += " sport=" + std::to_string(r.sport) + " inner_ttl=" + ttl + " rtt_ms=";
+        append_ms(out, r.value);
+        break;
+    case Event::IcmpUnmatched:
+        out += "ICMP_TIME_EXCEEDED (unmatched) sport=" + std::to_string(r.sport);
+        break;
+    case Event::DestReply:
+        out += names.tag(r.target) + "DEST_REPLY type=";
+        out += reply_kind_name(r.kind);
+        out += " sport=" + std::to_string(r.sport) + " rtt_ms=";
+        append_ms(out, r.value);
+        break;
+    case Event::HopSummary:
+        out += names.tag(r.target) + "HOP_SUMMARY ttl=" + ttl + " replies=" + std::to_string(r.value) +
+               " reached=" + std::to_string(r.kind ? 1 : 0);
+        break;
+    case Event::NoIcmpThisHop:
+        out += names.tag(r.target) + "NO_ICMP_THIS_HOP ttl=" + ttl + " (timeout)";
+        break;
+    case Event::HopCancel:
+        out += names.tag(r.target) + "HOP_CANCEL ttl=" + ttl + " (past destination)";
+        break;
+    case Event::Stop:
+        out += names.tag(r.target) + "STOP: destination reached at ttl=" + ttl;
+        break;
+    case Event::ParallelTtl:
+        out += names.tag(r.target) + "PARALLEL_TTL window=" + std::to_string(r.value);
+        break;
+    case Event::ConnectResult:
+        out += names.tag(r.target) + "CONNECT_RESULT sport=" + std::to_string(r.sport) +
+               " err=" + std::to_string(r.value);
+        if (r.value)
+            out += std::string(" (") + std::strerror(static_cast<int>(r.value)) + ")";
+        break;
+    case Event::SweepReply:
+        out += "SWEEP_REPLY type=";
+        out += reply_kind_name(r.kind);
+        out += " target=" + names.name(r.target) + " ttl=" + ttl;
+        if (static_cast<ReplyKind>(r.kind) == ReplyKind::Icmp) {
+            out += " from=";
+            append_addr(out, r.addr);
+        }
+        out += " rtt_ms=";
+        append_ms(out, r.value);
+        break;
+    default:
+        out += "UNKNOWN_EVENT type=" + std::to_string(r.type);
+        break;
+    }
+    return true;
+}
+
+const char* Timestamp::format(int64_t ts_ns) {
+    const int64_t sec = ts_ns / 1000000000;
+    if (sec != sec_) {
+        std::time_t tt = static_cast<std::time_t>(sec);
+        std::tm tm{};
+#if defined(_WIN32)
+        localtime_s(&tm, &tt);
+#else
+        localtime_r(&tt, &tm);
+#endif
+        std::strftime(buf_, sizeof(buf_), "%Y-%m-%d %H:%M:%S", &tm);
+        sec_ = sec;
+    }
+    const int ms = static_cast<int>((ts_ns / 1000000) % 1000);
+    char* p = buf_ + 19;
+    p[0] = '.';
+    p[1] = static_cast<char>('0' + ms / 100);
+    p[2] = static_cast<char>('0' + ms / 10 % 10);
+    p[3] = static_cast<char>('0' + ms % 10);
+    p[4] = '\0';
+    return buf_;
+}
+
+} // namespace geo::diag
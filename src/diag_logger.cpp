@@ -1,42 +1,198 @@
 // ===================== File: src/diag_logger.cpp =====================
 #include "diag_logger.hpp"
+#include <algorithm>
 #include <chrono>
-#include <ctime>
-#include <iomanip>
-#include <sstream>
+#include <cstring>
 
 namespace geo {
 
-static std::string now_ts() {
-    using namespace std::chrono;
-    auto t  = system_clock::now();
-    auto tt = system_clock::to_time_t(t);
-    auto ms = duration_cast<milliseconds>(t.time_since_epoch()) % 1000;
+namespace {
+constexpr std::size_t kBatchBytes = 64 * 1024; // write() once this much is pending
 
-    std::tm tm{};
-#if defined(_WIN32)
-    localtime_s(&tm, &tt);
-#else
-    localtime_r(&tt, &tm);
-#endif
-    std::ostringstream oss;
-    oss << std::put_time(&tm, "%Y-%m-%d %H:%M:%S") << '.'
-        << std::setw(3) << std::setfill('0') << ms.count();
-    return oss.str();
+int64_t now_ns() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count();
 }
+} // namespace
+
+DiagLogger::DiagLogger(const std::string& path, Mode mode, Format format)
+    : out_(path, format == Format::Binary ? std::ios::app | std::ios::binary : std::ios::app),
+      mode_(mode), format_(format) {
+    if (!out_.is_open())
+        return;
+    buf_.reserve(kBatchBytes + 4096);
 
-DiagLogger::DiagLogger(const std::string& path) : out_(path, std::ios::app) {
-    if (out_.is_open()) out_ << "=== geo_tracer diag start " << now_ts() << " ===\n";
+    diag::Record start = diag::make(diag::Event::LogStart);
+    start.ts_ns = now_ns();
+    write(start, nullptr);
+    out_ << buf_;
+    out_.flush();
+    buf_.clear();
+
+    if (mode_ == Mode::Async) {
+        slots_.reset(new Slot[kSlots]);
+        for (std::size_t i = 0; i < kSlots; ++i)
+            slots_[i].seq.store(i, std::memory_order_relaxed);
+        writer_ = std::thread([this] { writer_loop(); });
+    }
 }
 
 DiagLogger::~DiagLogger() {
-    if (out_.is_open()) out_ << "=== geo_tracer diag end " << now_ts() << " ===\n";
+    if (writer_.joinable()) {
+        stop_.store(true, std::memory_order_release);
+        writer_.join();
+    }
+    if (!out_.is_open())
+        return;
+    diag::Record end = diag::make(diag::Event::LogEnd);
+    end.ts_ns = now_ns();
+    write(end, nullptr);
+    out_ << buf_;
+    buf_.clear();
+}
+
+// Append one record to buf_ in the file's format (writer side only).
+void DiagLogger::write(const diag::Record& r, const char* payload) {
+    if (format_ == Format::Binary) {
+        buf_.append(reinterpret_cast<const char*>(&r), sizeof(r));
+        if (r.len)
+            buf_.append(payload, r.len);
+        return;
+    }
+
+    const char* ts = stamp_.format(r.ts_ns);
+    switch (static_cast<diag::Event>(r.type)) {
+    case diag::Event::LogStart:
+        buf_ += "=== geo_tracer diag start ";
+        buf_ += ts;
+        buf_ += " ===\n";
+        return;
+    case diag::Event::LogEnd:
+        buf_ += "=== geo_tracer diag end ";
+        buf_ += ts;
+        buf_ += " ===\n";
+        return;
+    default:
+        break;
+    }
+    line_.clear();
+    if (!diag::render(line_, r, payload, names_))
+        return;
+    buf_ += ts;
+    buf_ += " | ";
+    buf_ += line_;
+    buf_ += '\n';
 }
 
 void DiagLogger::log(const std::string& line) {
+    diag::Record r = diag::make(diag::Event::Text);
+    r.len = static_cast<uint16_t>(std::min<std::size_t>(line.size(), UINT16_MAX));
+    emit(r, line.data());
+}
+
+void DiagLogger::event(diag::Record r) {
+    r.len = 0;
+    emit(r, nullptr);
+}
+
+void DiagLogger::name_target(uint32_t target, const std::string& name, bool tag_lines) {
+    diag::Record r = diag::make(diag::Event::TargetName, target);
+    r.kind = tag_lines ? 1 : 0;
+    r.len = static_cast<uint16_t>(std::min<std::size_t>(name.size(), UINT16_MAX));
+    emit(r, name.data(), true);
+}
+
+void DiagLogger::emit(diag::Record r, const char* payload, bool wait) {
     if (!out_.is_open()) return;
-    out_ << now_ts() << " | " << line << '\n';
-    out_.flush();
+    r.ts_ns = now_ns();
+
+    if (mode_ == Mode::Sync) {
+        write(r, payload);
+        if (format_ == Format::Text) {
+            out_ << buf_;
+            out_.flush();
+            buf_.clear();
+        } else if (buf_.size() >= kBatchBytes) {
+            out_ << buf_;
+            buf_.clear();
+        }
+        return;
+    }
+
+    // claim a slot (bounded MPMC ring, Vyukov style); full ring -> drop,
+    // or let the writer catch up if this record must not be lost
+    uint64_t pos = head_.load(std::memory_order_relaxed);
+    Slot* s;
+    for (;;) {
+        s = &slots_[pos & (kSlots - 1)];
+        const uint64_t seq = s->seq.load(std::memory_order_acquire);
+        const int64_t diff = static_cast<int64_t>(seq - pos);
+        if (diff == 0) {
+            if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            if (!wait) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            std::this_thread::yield();
+            pos = head_.load(std::memory_order_relaxed);
+        } else {
+            pos = head_.load(std::memory_order_relaxed);
+        }
+    }
+    r.len = static_cast<uint16_t>(std::min<std::size_t>(r.len, kMaxPayload));
+    s->rec = r;
+    if (r.len)
+        std::memcpy(s->payload, payload, r.len);
+    s->seq.store(pos + 1, std::memory_order_release);
+}
+
+// Format everything published so far into buf_; false if there was nothing.
+bool DiagLogger::drain() {
+    bool any = false;
+    for (;;) {
+        Slot& s = slots_[tail_ & (kSlots - 1)];
+        if (s.seq.load(std::memory_order_acquire) != tail_ + 1)
+            break;
+        write(s.rec, s.payload);
+        s.seq.store(tail_ + kSlots, std::memory_order_release);
+        tail_++;
+        any = true;
+        if (buf_.size() >= kBatchBytes) {
+            out_ << buf_;
+            buf_.clear();
+        }
+    }
+
+    const uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+    if (dropped != dropped_reported_) {
+        const std::string note = "WARN diag ring overflow: " + std::to_string(dropped - dropped_reported_) +
+                                 " lines dropped";
+        diag::Record r = diag::make(diag::Event::Text);
+        r.ts_ns = now_ns();
+        r.len = static_cast<uint16_t>(note.size());
+        write(r, note.data());
+        dropped_reported_ = dropped;
+        any = true;
+    }
+    return any;
+}
+
+void DiagLogger::writer_loop() {
+    for (;;) {
+        // read the flag first so a final drain sees everything logged before it
+        const bool stopping = stop_.load(std::memory_order_acquire);
+        if (drain()) {
+            out_ << buf_;
+            out_.flush();
+            buf_.clear();
+        } else if (!stopping) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (stopping)
+            return;
+    }
 }
 
 } // namespace geo
@@ -0,0 +1,106 @@
+// ===================== File: src/event_loop.cpp =====================
+#include "event_loop.hpp"
+
+#include <cerrno>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace geo {
+
+namespace {
+enum : uint8_t { kNone, kHandler, kTagged }; // EventLoop::live_
+}
+
+EventLoop::EventLoop() : events_(64) {
+    epfd_ = ::epoll_create1(EPOLL_CLOEXEC);
+    if (epfd_ < 0)
+        throw std::runtime_error("epoll_create1 failed");
+}
+
+EventLoop::~EventLoop() {
+    if (epfd_ >= 0) ::close(epfd_);
+}
+
+bool EventLoop::add(int fd, uint32_t events) {
+    if (fd < 0) return false;
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.fd = fd;
+    if (::epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev) < 0)
+        return false;
+    if (static_cast<size_t>(fd) >= handlers_.size()) {
+        handlers_.resize(static_cast<size_t>(fd) + 1);
+        tags_.resize(static_cast<size_t>(fd) + 1, 0);
+        live_.resize(static_cast<size_t>(fd) + 1, kNone);
+    }
+    return true;
+}
+
+bool EventLoop::watch(int fd, uint32_t events, Handler h) {
+    if (!add(fd, events))
+        return false;
+    handlers_[fd] = std::move(h);
+    live_[fd] = kHandler;
+    return true;
+}
+
+bool EventLoop::watch_tagged(int fd, uint32_t events, uint64_t tag) {
+    if (!add(fd, events))
+        return false;
+    tags_[fd] = tag;
+    live_[fd] = kTagged;
+    return true;
+}
+
+bool EventLoop::rearm(int fd, uint32_t events) {
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.fd = fd;
+    return ::epoll_ctl(epfd_, EPOLL_CTL_MOD, fd, &ev) == 0;
+}
+
+void EventLoop::unwatch(int fd) {
+    if (fd < 0) return;
+    (void)::epoll_ctl(epfd_, EPOLL_CTL_DEL, fd, nullptr);
+    if (static_cast<size_t>(fd) >= handlers_.size()) return;
+    if (live_[fd] == kTagged) {
+        live_[fd] = kNone;
+        return;
+    }
+    live_[fd] = kNone;
+    // the handler may be the one currently running; drop it afterwards
+    if (dispatching_) dead_.push_back(fd);
+    else              handlers_[fd] = nullptr;
+}
+
+int EventLoop::poll_once(int max_wait_ms, std::vector<uint64_t>& expired) {
+    int wait = timers_.ms_until_next(TimerWheel::clock::now());
+    if (max_wait_ms >= 0 && (wait < 0 || wait > max_wait_ms))
+        wait = max_wait_ms;
+
+    int n = ::epoll_wait(epfd_, events_.data(), static_cast<int>(events_.size()), wait);
+    if (n < 0 && errno != EINTR)
+        throw std::runtime_error("epoll_wait failed");
+
+    dispatching_ = true;
+    for (int i = 0; i < n; ++i) {
+        int fd = events_[i].data.fd;
+        // a handler earlier in this batch may have unwatched this fd
+        if (static_cast<size_t>(fd) >= handlers_.size()) continue;
+        if (live_[fd] == kHandler)
+            handlers_[fd](events_[i].events);
+        else if (live_[fd] == kTagged)
+            tag_handler_(tags_[fd], events_[i].events);
+    }
+    dispatching_ = false;
+    for (int fd : dead_)
+        if (live_[fd] != kHandler) handlers_[fd] = nullptr;
+    dead_.clear();
+    if (n == static_cast<int>(events_.size()))
+        events_.resize(events_.size() * 2);
+
+    timers_.advance(TimerWheel::clock::now(), expired);
+    return n < 0 ? 0 : n;
+}
+
+} // namespace geo
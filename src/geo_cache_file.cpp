@@ -0,0 +1,406 @@
+// ===================== File: src/geo_cache_file.cpp =====================
+#include "geo_cache_file.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace geo {
+
+namespace {
+constexpr char kMagic[8] = {'G', 'E', 'O', 'C', 'A', 'C', 'H', '1'};
+constexpr uint32_t kVersion = 1;
+constexpr int kStrings = 7; // city, country, isp, org, as_text, asn, as_name
+constexpr std::size_t kMaxString = 255;
+
+int64_t unix_now() {
+    using namespace std::chrono;
+    return duration_cast<seconds>(system_clock::now().time_since_epoch()).count();
+}
+
+// What a slot holds, copied out as a unit under the slot's seqlock
+struct SlotData {
+    int64_t expires;   // unix seconds
+    double lat, lon;
+    uint32_t heap_off;
+    uint32_t key;      // IPv4, host order; 0 = empty slot
+    uint8_t len[kStrings];
+    uint8_t negative;  // cached lookup failure
+};
+static_assert(sizeof(SlotData) == 40, "geo cache slot layout");
+
+std::string* fields(GeoInfo& g, int i) {
+    std::string* f[kStrings] = {&g.city, &g.country, &g.isp, &g.org, &g.as_text, &g.asn, &g.as_name};
+    return f[i];
+}
+} // namespace
+
+struct GeoCacheFile::Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t slot_count;             // power of two
+    uint64_t heap_capacity;
+    std::atomic<uint64_t> heap_used; // bytes appended so far
+    std::atomic<uint32_t> entries;   // occupied slots, expired ones included
+    std::atomic<uint32_t> retired;   // 1 once a compacted copy replaced this file
+    uint8_t pad[24];
+};
+
+struct GeoCacheFile::Slot {
+    std::atomic<uint32_t> seq; // odd while a writer is updating the slot
+    SlotData d;
+};
+
+namespace {
+template <typename Slot>
+bool read_slot(const Slot& s, SlotData& d) {
+    for (int spin = 0; spin < 1000; ++spin) {
+        const uint32_t s1 = s.seq.load(std::memory_order_acquire);
+        if (s1 & 1)
+            continue;
+        std::memcpy(&d, &s.d, sizeof(d));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (s.seq.load(std::memory_order_relaxed) == s1)
+            return true;
+    }
+    return false; // writer died mid-update; treated as a miss until rewritten
+}
+
+template <typename Slot>
+void write_slot(Slot& s, const SlotData& d) {
+    uint32_t q = s.seq.load(std::memory_order_relaxed);
+    if (!(q & 1))
+        ++q;
+    s.seq.store(q, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(&s.d, &d, sizeof(d));
+    s.seq.store(q + 1, std::memory_order_release);
+}
+
+uint32_t home_slot(uint32_t ip, uint32_t slot_count) {
+    const int bits = __builtin_ctz(slot_count);
+    return bits ? (ip * 2654435761u) >> (32 - bits) : 0;
+}
+
+std::size_t file_size(uint32_t slot_count, uint64_t heap_capacity) {
+    return 64 + std::size_t{slot_count} * 48 + heap_capacity;
+}
+} // namespace
+
+GeoCacheFile::~GeoCacheFile() {
+    unmap();
+}
+
+GeoCacheFile::Header* GeoCacheFile::header() const { return reinterpret_cast<Header*>(base_); }
+GeoCacheFile::Slot* GeoCacheFile::slots() const { return reinterpret_cast<Slot*>(base_ + sizeof(Header)); }
+char* GeoCacheFile::heap() const { return base_ + sizeof(Header) + std::size_t{header()->slot_count} * sizeof(Slot); }
+
+bool GeoCacheFile::retired() const {
+    return header()->retired.load(std::memory_order_acquire) != 0;
+}
+
+void GeoCacheFile::unmap() {
+    if (base_)
+        ::munmap(base_, size_);
+    if (fd_ >= 0)
+        ::close(fd_);
+    base_ = nullptr;
+    size_ = 0;
+    fd_ = -1;
+}
+
+// Validate (creating it first if empty) and map the file behind `fd`; takes
+// ownership of fd either way.
+bool GeoCacheFile::map_file(int fd, bool writable) {
+    // the creator initializes under LOCK_EX; everyone validates under a lock
+    if (::flock(fd, writable ? LOCK_EX : LOCK_SH) != 0) {
+        ::close(fd);
+        return false;
+    }
+    struct stat st{};
+    bool ok = ::fstat(fd, &st) == 0;
+    if (ok && st.st_size == 0 && writable) {
+        Header h{};
+        std::memcpy(h.magic, kMagic, sizeof(kMagic));
+        h.version = kVersion;
+        h.slot_count = kDefaultSlots;
+        h.heap_capacity = kDefaultHeap;
+        ok = ::ftruncate(fd, static_cast<off_t>(file_size(h.slot_count, h.heap_capacity))) == 0 &&
+             ::pwrite(fd, &h, sizeof(h), 0) == static_cast<ssize_t>(sizeof(h)) &&
+             ::fstat(fd, &st) == 0;
+    }
+
+    Header h{};
+    ok = ok && ::pread(fd, &h, sizeof(h), 0) == static_cast<ssize_t>(sizeof(h)) &&
+         std::memcmp(h.magic, kMagic, sizeof(kMagic)) == 0 && h.version == kVersion &&
+         h.slot_count != 0 && (h.slot_count & (h.slot_count - 1)) == 0 &&
+         static_cast<uint64_t>(st.st_size) == file_size(h.slot_count, h.heap_capacity);
+
+    void* map = MAP_FAILED;
+    if (ok)
+        map = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ | (writable ? PROT_WRITE : 0),
+                     MAP_SHARED, fd, 0);
+    ::flock(fd, LOCK_UN);
+    if (map == MAP_FAILED) {
+        ::close(fd);
+        return false;
+    }
+
+    unmap();
+    fd_ = fd;
+    writable_ = writable;
+    base_ = static_cast<char*>(map);
+    size_ = static_cast<std::size_t>(st.st_size);
+    return true;
+}
+
+void GeoCacheFile::open(const std::string& path) {
+    static_assert(sizeof(Header) == 64 && sizeof(Slot) == 48, "geo cache file layout");
+    std::unique_lock<std::shared_mutex> lk(map_mu_);
+    path_ = path;
+    bool writable = true;
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0 && (errno == EACCES || errno == EROFS)) {
+        writable = false;
+        fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    if (fd < 0)
+        throw std::runtime_error("geo cache " + path + ": " + std::strerror(errno));
+    if (!map_file(fd, writable))
+        throw std::runtime_error("geo cache " + path + ": not a geo cache file (or unreadable)");
+}
+
+// Another process compacted the cache: follow it to the new file
+void GeoCacheFile::reopen_if_retired() {
+    {
+        std::shared_lock<std::shared_mutex> lk(map_mu_);
+        if (!base_ || !retired())
+            return;
+    }
+    std::unique_lock<std::shared_mutex> lk(map_mu_);
+    if (!base_ || !retired())
+        return;
+    const int fd = ::open(path_.c_str(), (writable_ ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+    if (fd >= 0)
+        (void)map_file(fd, writable_); // on failure keep reading the stale copy
+}
+
+bool GeoCacheFile::find(uint32_t ip, std::optional<GeoInfo>& out, std::chrono::system_clock::time_point& expires) {
+    if (ip == 0)
+        return false;
+    reopen_if_retired();
+    std::shared_lock<std::shared_mutex> lk(map_mu_);
+    if (!base_)
+        return false;
+
+    const Header* h = header();
+    const uint32_t mask = h->slot_count - 1;
+    uint32_t i = home_slot(ip, h->slot_count);
+    SlotData d{};
+    for (uint32_t n = 0;; ++n, i = (i + 1) & mask) {
+        if (n == h->slot_count || !read_slot(slots()[i], d) || d.key == 0)
+            return false;
+        if (d.key == ip)
+            break;
+    }
+    const int64_t now = unix_now();
+    if (d.expires <= now)
+        return false;
+    expires = std::chrono::system_clock::time_point(std::chrono::seconds(d.expires));
+
+    if (d.negative) {
+        out.reset();
+        return true;
+    }
+    std::size_t total = 0;
+    for (int k = 0; k < kStrings; ++k)
+        total += d.len[k];
+    if (d.heap_off + total > h->heap_used.load(std::memory_order_acquire))
+        return false;
+
+    GeoInfo g{};
+    in_addr a{};
+    a.s_addr = htonl(ip);
+    char buf[INET_ADDRSTRLEN];
+    if (inet_ntop(AF_INET, &a, buf, sizeof(buf)))
+        g.ip = buf;
+    g.lat = d.lat;
+    g.lon = d.lon;
+    const char* p = heap() + d.heap_off;
+    for (int k = 0; k < kStrings; ++k) {
+        fields(g, k)->assign(p, d.len[k]);
+        p += d.len[k];
+    }
+    out = std::move(g);
+    return true;
+}
+
+void GeoCacheFile::store(uint32_t ip, const std::optional<GeoInfo>& info, std::chrono::seconds ttl) {
+    if (ip == 0)
+        return;
+
+    SlotData d{};
+    d.key = ip;
+    d.expires = unix_now() + ttl.count();
+    d.negative = info ? 0 : 1;
+    GeoInfo g = info.value_or(GeoInfo{});
+    d.lat = g.lat;
+    d.lon = g.lon;
+    uint32_t need = 0;
+    for (int k = 0; k < kStrings; ++k) {
+        d.len[k] = static_cast<uint8_t>(std::min(fields(g, k)->size(), kMaxString));
+        need += d.len[k];
+    }
+
+    std::lock_guard<std::mutex> wl(write_mu_);
+    for (int attempt = 0; attempt < 3; ++attempt) {
+        reopen_if_retired();
+        {
+            std::shared_lock<std::shared_mutex> lk(map_mu_);
+            if (!base_ || !writable_ || ::flock(fd_, LOCK_EX) != 0)
+                return;
+            if (retired()) {
+                ::flock(fd_, LOCK_UN);
+                continue;
+            }
+
+            Header* h = header();
+            const uint32_t mask = h->slot_count - 1;
+            uint32_t i = home_slot(ip, h->slot_count);
+            Slot* slot = nullptr;
+            bool fresh = false;
+            for (uint32_t n = 0; n < h->slot_count; ++n, i = (i + 1) & mask) {
+                const uint32_t key = slots()[i].d.key; // we are the only writer
+                if (key == ip || key == 0) {
+                    slot = &slots()[i];
+                    fresh = key == 0;
+                    break;
+                }
+            }
+            const uint64_t off = h->heap_used.load(std::memory_order_relaxed);
+            const bool full = !slot || off + need > h->heap_capacity ||
+                              (fresh && (h->entries.load(std::memory_order_relaxed) + 1) * 4 > h->slot_count * 3);
+            if (!full) {
+                d.heap_off = static_cast<uint32_t>(off);
+                char* p = heap() + off;
+                for (int k = 0; k < kStrings; ++k) {
+                    std::memcpy(p, fields(g, k)->data(), d.len[k]);
+                    p += d.len[k];
+                }
+                h->heap_used.store(off + need, std::memory_order_release);
+                write_slot(*slot, d);
+                if (fresh)
+                    h->entries.fetch_add(1, std::memory_order_relaxed);
+                ::flock(fd_, LOCK_UN);
+                return;
+            }
+            ::flock(fd_, LOCK_UN);
+        }
+
+        // out of room: rebuild into a bigger file, then retry the insert
+        std::unique_lock<std::shared_mutex> lk(map_mu_);
+        if (!base_ || ::flock(fd_, LOCK_EX) != 0)
+            return;
+        if (retired() || !compact(need))
+            ::flock(fd_, LOCK_UN);
+    }
+}
+
+// Copy every unexpired entry into a fresh, roomier file and rename() it over
+// path_. Called with map_mu_ exclusive and the file flock()ed; on success
+// this object now maps the new file.
+bool GeoCacheFile::compact(uint32_t need_heap) {
+    const Header* h = header();
+    const int64_t now = unix_now();
+    uint32_t live = 0;
+    uint64_t bytes = 0;
+    for (uint32_t i = 0; i < h->slot_count; ++i) {
+        const SlotData& d = slots()[i].d;
+        if (d.key == 0 || d.expires <= now)
+            continue;
+        live++;
+        for (int k = 0; k < kStrings; ++k)
+            bytes += d.len[k];
+    }
+
+    // leave the table at most 3/8 full and the heap at most half full
+    uint32_t slot_count = kDefaultSlots;
+    while (uint64_t{slot_count} * 3 < (uint64_t{live} + 1) * 8)
+        slot_count *= 2;
+    uint64_t heap_capacity = std::max<uint64_t>(kDefaultHeap, (bytes + need_heap) * 2);
+    heap_capacity = (heap_capacity + 4095) & ~uint64_t{4095};
+    if (heap_capacity > UINT32_MAX)
+        return false;
+    const std::size_t size = file_size(slot_count, heap_capacity);
+
+    const std::string tmp = path_ + ".tmp." + std::to_string(::getpid());
+    const int fd = ::open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return false;
+    struct stat st{};
+    if (::fstat(fd_, &st) == 0)
+        (void)::fchmod(fd, st.st_mode & 0777);
+    void* map = MAP_FAILED;
+    if (::ftruncate(fd, static_cast<off_t>(size)) == 0)
+        map = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        ::close(fd);
+        ::unlink(tmp.c_str());
+        return false;
+    }
+
+    char* nbase = static_cast<char*>(map);
+    auto* nh = reinterpret_cast<Header*>(nbase);
+    std::memcpy(nh->magic, kMagic, sizeof(kMagic));
+    nh->version = kVersion;
+    nh->slot_count = slot_count;
+    nh->heap_capacity = heap_capacity;
+    auto* nslots = reinterpret_cast<Slot*>(nbase + sizeof(Header));
+    char* nheap = nbase + sizeof(Header) + std::size_t{slot_count} * sizeof(Slot);
+
+    uint64_t used = 0;
+    uint32_t entries = 0;
+    for (uint32_t i = 0; i < h->slot_count; ++i) {
+        SlotData d = slots()[i].d;
+        if (d.key == 0 || d.expires <= now)
+            continue;
+        uint32_t len = 0;
+        for (int k = 0; k < kStrings; ++k)
+            len += d.len[k];
+        std::memcpy(nheap + used, heap() + d.heap_off, len);
+        d.heap_off = static_cast<uint32_t>(used);
+        used += len;
+        uint32_t j = home_slot(d.key, slot_count);
+        while (nslots[j].d.key != 0)
+            j = (j + 1) & (slot_count - 1);
+        nslots[j].d = d;
+        entries++;
+    }
+    nh->heap_used.store(used, std::memory_order_relaxed);
+    nh->entries.store(entries, std::memory_order_relaxed);
+
+    if (::rename(tmp.c_str(), path_.c_str()) != 0) {
+        ::munmap(map, size);
+        ::close(fd);
+        ::unlink(tmp.c_str());
+        return false;
+    }
+    header()->retired.store(1, std::memory_order_release);
+    ::flock(fd_, LOCK_UN);
+
+    unmap();
+    fd_ = fd;
+    base_ = nbase;
+    size_ = size;
+    return true;
+}
+
+} // namespace geo
@@ -0,0 +1,323 @@
+// ===================== File: src/geo_json.cpp =====================
+#include "geo_json.hpp"
+
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+
+namespace geo::json {
+
+namespace {
+bool is_ws(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+
+void skip_ws(std::string_view s, std::size_t& pos) {
+    while (pos < s.size() && is_ws(s[pos]))
+        ++pos;
+}
+
+// `pos` just past an opening quote -> just past the closing one; `end` is
+// the closing quote's offset
+bool skip_string(std::string_view s, std::size_t& pos, std::size_t& end) {
+    for (;;) {
+        const void* q = pos < s.size() ? std::memchr(s.data() + pos, '"', s.size() - pos) : nullptr;
+        if (!q)
+            return false;
+        const std::size_t i = static_cast<const char*>(q) - s.data();
+        std::size_t bs = 0;
+        while (s[i - 1 - bs] == '\\') // s[pos - 1] is the opening quote
+            ++bs;
+        pos = i + 1;
+        if (bs % 2 == 0) {
+            end = i;
+            return true;
+        }
+    }
+}
+
+// `pos` at '{' or '[' -> just past the matching bracket
+bool skip_nested(std::string_view s, std::size_t& pos) {
+    int depth = 0;
+    std::size_t end;
+    while (pos < s.size()) {
+        const char c = s[pos++];
+        if (c == '"') {
+            if (!skip_string(s, pos, end))
+                return false;
+        } else if (c == '{' || c == '[') {
+            ++depth;
+        } else if (c == '}' || c == ']') {
+            if (--depth == 0)
+                return true;
+            if (depth < 0)
+                return false;
+        }
+    }
+    return false;
+}
+
+bool is_scalar_char(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || c == '-' || c == '+' || c == '.' || c == 'E';
+}
+
+int hex4(std::string_view s, std::size_t i) {
+    if (i + 4 > s.size())
+        return -1;
+    int v = 0;
+    for (std::size_t k = i; k < i + 4; ++k) {
+        const char c = s[k];
+        v <<= 4;
+        if (c >= '0' && c <= '9')
+            v |= c - '0';
+        else if (c >= 'a' && c <= 'f')
+            v |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            v |= c - 'A' + 10;
+        else
+            return -1;
+    }
+    return v;
+}
+
+void put_utf8(std::string& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+bool unescape(std::string_view s, std::string& out) {
+    out.clear();
+    out.reserve(s.size());
+    for (std::size_t i = 0; i < s.size();) {
+        const void* bs = std::memchr(s.data() + i, '\\', s.size() - i);
+        const std::size_t j = bs ? static_cast<const char*>(bs) - s.data() : s.size();
+        out.append(s.data() + i, j - i);
+        if (j + 1 >= s.size())
+            return j == s.size();
+        i = j + 2;
+        switch (s[j + 1]) {
+        case '"': out += '"'; break;
+        case '\\': out += '\\'; break;
+        case '/': out += '/'; break;
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'u': {
+            const int hi = hex4(s, i);
+            if (hi < 0)
+                return false;
+            i += 4;
+            uint32_t cp = static_cast<uint32_t>(hi);
+            if (cp >= 0xD800 && cp < 0xDC00) {
+                const int lo = i + 1 < s.size() && s[i] == '\\' && s[i + 1] == 'u' ? hex4(s, i + 2) : -1;
+                if (lo >= 0xDC00 && lo < 0xE000) {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (static_cast<uint32_t>(lo) - 0xDC00);
+                    i += 6;
+                } else {
+                    cp = 0xFFFD; // unpaired surrogate
+                }
+            } else if (cp >= 0xDC00 && cp < 0xE000) {
+                cp = 0xFFFD;
+            }
+            put_utf8(out, cp);
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+} // namespace
+
+ObjectScanner::ObjectScanner(std::string_view text) : s_(text) {}
+
+bool ObjectScanner::fail() {
+    ok_ = false;
+    done_ = true;
+    return false;
+}
+
+bool ObjectScanner::next(std::string_view& key, Value& value) {
+    if (done_)
+        return false;
+    skip_ws(s_, pos_);
+    if (pos_ >= s_.size())
+        return fail();
+    if (first_) {
+        if (s_[pos_++] != '{')
+            return fail();
+        first_ = false;
+        skip_ws(s_, pos_);
+        if (pos_ < s_.size() && s_[pos_] == '}') {
+            ++pos_;
+            done_ = true;
+            return false;
+        }
+    } else {
+        const char c = s_[pos_++];
+        if (c == '}') {
+            done_ = true;
+            return false;
+        }
+        if (c != ',')
+            return fail();
+        skip_ws(s_, pos_);
+    }
+
+    // "key"
+    std::size_t end;
+    if (pos_ >= s_.size() || s_[pos_++] != '"')
+        return fail();
+    const std::size_t k0 = pos_;
+    if (!skip_string(s_, pos_, end))
+        return fail();
+    key = s_.substr(k0, end - k0);
+    skip_ws(s_, pos_);
+    if (pos_ >= s_.size() || s_[pos_++] != ':')
+        return fail();
+    skip_ws(s_, pos_);
+    if (pos_ >= s_.size())
+        return fail();
+
+    // value
+    const std::size_t v0 = pos_;
+    const char c = s_[pos_];
+    if (c == '"') {
+        ++pos_;
+        if (!skip_string(s_, pos_, end))
+            return fail();
+        value.kind = Value::String;
+        value.raw = s_.substr(v0 + 1, end - v0 - 1);
+        value.escaped = value.raw.find('\\') != std::string_view::npos;
+        return true;
+    }
+    value.escaped = false;
+    if (c == '{' || c == '[') {
+        if (!skip_nested(s_, pos_))
+            return fail();
+        value.kind = c == '{' ? Value::Object : Value::Array;
+    } else {
+        while (pos_ < s_.size() && is_scalar_char(s_[pos_]))
+            ++pos_;
+        if (pos_ == v0)
+            return fail();
+        value.kind = c == '-' || (c >= '0' && c <= '9') ? Value::Number : Value::Literal;
+    }
+    value.raw = s_.substr(v0, pos_ - v0);
+    return true;
+}
+
+bool string(const Value& v, std::string& out) {
+    if (v.kind != Value::String) {
+        out.clear();
+        return false;
+    }
+    if (!v.escaped) {
+        out.assign(v.raw);
+        return true;
+    }
+    if (!unescape(v.raw, out)) {
+        out.clear();
+        return false;
+    }
+    return true;
+}
+
+bool number(const Value& v, double& out) {
+    const char* e = v.raw.data() + v.raw.size();
+    double d;
+    if (v.kind != Value::Number || std::from_chars(v.raw.data(), e, d).ptr != e)
+        return false;
+    out = d;
+    return true;
+}
+
+std::vector<std::string_view> array_objects(std::string_view text) {
+    std::vector<std::string_view> out;
+    std::size_t pos = 0, end;
+    skip_ws(text, pos);
+    if (pos >= text.size() || text[pos++] != '[')
+        return out;
+    while (pos < text.size()) {
+        const char c = text[pos];
+        if (c == '{') {
+            const std::size_t o0 = pos;
+            if (!skip_nested(text, pos))
+                break;
+            out.push_back(text.substr(o0, pos - o0));
+        } else if (c == '[') {
+            if (!skip_nested(text, pos))
+                break;
+        } else if (c == '"') {
+            ++pos;
+            if (!skip_string(text, pos, end))
+                break;
+        } else if (c == ']') {
+            break;
+        } else {
+            ++pos; // whitespace, commas, scalars
+        }
+    }
+    return out;
+}
+
+std::optional<GeoInfo> parse_ip_api(std::string_view obj, std::string* query) {
+    GeoInfo g{};
+    bool success = false;
+    ObjectScanner sc(obj);
+    std::string_view key;
+    Value v;
+    while (sc.next(key, v)) {
+        if (key == "status")
+            success = v.kind == Value::String && v.raw == "success";
+        else if (key == "country")
+            string(v, g.country);
+        else if (key == "city")
+            string(v, g.city);
+        else if (key == "lat")
+            number(v, g.lat);
+        else if (key == "lon")
+            number(v, g.lon);
+        else if (key == "isp")
+            string(v, g.isp);
+        else if (key == "org")
+            string(v, g.org);
+        else if (key == "as")
+            string(v, g.as_text);
+        else if (key == "asname")
+            string(v, g.as_name);
+        else if (key == "query" && query)
+            string(v, *query);
+    }
+    if (!success)
+        return std::nullopt;
+    g.asn.assign(asn_prefix(g.as_text));
+    return g;
+}
+
+std::string_view asn_prefix(std::string_view as_text) {
+    for (std::size_t p = as_text.find("AS"); p != std::string_view::npos; p = as_text.find("AS", p + 1)) {
+        std::size_t e = p + 2;
+        while (e < as_text.size() && as_text[e] >= '0' && as_text[e] <= '9')
+            ++e;
+        if (e > p + 2)
+            return as_text.substr(p, e - p);
+    }
+    return {};
+}
+
+} // namespace geo::json
@@ -1,85 +1,568 @@
 //// ===================== File: src/geo_r.cpp =====================
 #include "geo_resolver.hpp"
-#include "dns_resolver.hpp"
-#include "tcp_socket.hpp"
+#include "geo_cache_file.hpp"
+#include "geo_json.hpp"
+#include "mmdb_reader.hpp"
+#include "http_client.hpp"
+#include "ip_prefix.hpp"
 
+#include <algorithm>
 #include <arpa/inet.h>
-#include <regex>
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
 namespace geo
 {
-    // Very small HTTP client to ip-api.com (no HTTPS). Free tier is fine for traceroute volume.
+    static const char *const kGeoHost = "ip-api.com";
+    // include ASN/ISP/org fields
+    static const char *const kGeoFields = "fields=status,country,city,lat,lon,isp,org,as,asname";
+
+    // Keep-alive connections to ip-api.com (plain HTTP; the free tier has no
+    // HTTPS), shared by every lookup in the process
+    static std::unique_ptr<HttpClient> &ip_api_client()
+    {
+        static std::unique_ptr<HttpClient> client = std::make_unique<HttpClient>(kGeoHost, 80);
+        return client;
+    }
+
+    static HttpClient &ip_api()
+    {
+        return *ip_api_client();
+    }
+
     // Example: GET /json/8.8.8.8?fields=status,country,city,lat,lon
-    static std::string http_get(const std::string &host, const std::string &path)
+    static std::optional<GeoInfo> fetch(const std::string &ip)
     {
-        auto addrs = DNSResolver::resolve(host, 80);
-        for (const auto &ra : addrs)
+        HttpRequest req;
+        req.path = "/json/" + ip + "?" + kGeoFields;
+        const HttpResponse resp = ip_api().request(req);
+        if (resp.status != 200)
+            return std::nullopt;
+        auto g = json::parse_ip_api(resp.body);
+        if (g)
+            g->ip = ip;
+        return g;
+    }
+
+    // POST /batch in requests of up to kBatchMax addresses, all pipelined on
+    // one connection. Results come back in `ips` order; ok[i] is false if
+    // the request carrying ips[i] failed.
+    static constexpr std::size_t kBatchMax = 100; // ip-api's limit per request
+
+    static std::vector<std::optional<GeoInfo>> fetch_batch(const std::vector<std::string> &ips, std::vector<char> &ok)
+    {
+        std::vector<HttpRequest> reqs;
+        for (std::size_t start = 0; start < ips.size(); start += kBatchMax)
+        {
+            HttpRequest req;
+            req.method = "POST";
+            req.path = std::string("/batch?") + kGeoFields + ",query";
+            req.content_type = "application/json";
+            req.body = "[";
+            for (std::size_t i = start; i < std::min(ips.size(), start + kBatchMax); ++i)
+            {
+                if (i > start)
+                    req.body += ',';
+                req.body += '"' + ips[i] + '"';
+            }
+            req.body += ']';
+            reqs.push_back(std::move(req));
+        }
+        const auto resps = ip_api().pipeline(reqs);
+
+        std::vector<std::optional<GeoInfo>> out(ips.size());
+        ok.assign(ips.size(), 0);
+        std::string query;
+        for (std::size_t r = 0; r < resps.size(); ++r)
         {
-            TcpSocket tcp;
-            if (!tcp.connectTo(ra))
+            const std::size_t start = r * kBatchMax, n = std::min(kBatchMax, ips.size() - start);
+            const auto objs = resps[r].status == 200 ? json::array_objects(resps[r].body)
+                                                     : std::vector<std::string_view>{};
+            if (objs.empty())
                 continue;
-            std::string req = "GET " + path + " HTTP/1.1\r\n"
-                                              "Host: " +
-                              host + "\r\n"
-                                     "Connection: close\r\n"
-                                     "\r\n";
-
-            if (!tcp.sendAll(req))
-                return {};
-            return tcp.recvAll();
+            std::fill(ok.begin() + start, ok.begin() + start + n, 1);
+
+            // normally one object per address, in order; match on "query"
+            // anyway (every slot, if an address was asked for twice)
+            std::unordered_multimap<std::string_view, std::size_t> pos;
+            for (std::size_t i = start; i < start + n; ++i)
+                pos.emplace(ips[i], i);
+            for (std::size_t k = 0; k < objs.size(); ++k)
+            {
+                query.clear();
+                auto g = json::parse_ip_api(objs[k], &query);
+                if (query.empty())
+                {
+                    if (k < n)
+                    {
+                        if (g)
+                            g->ip = ips[start + k];
+                        out[start + k] = std::move(g);
+                    }
+                    continue;
+                }
+                auto [lo, hi] = pos.equal_range(query);
+                for (auto it = lo; it != hi; ++it)
+                {
+                    out[it->second] = g;
+                    if (g)
+                        out[it->second]->ip = ips[it->second];
+                }
+            }
+        }
+        return out;
+    }
+
+    // Bounded LRU of lookup results (hits and failures) plus the requests
+    // currently on the wire, so a burst of hops through one router costs
+    // one round-trip. Misses fall through to the on-disk cache, if one is
+    // open, before going to the network. Capacity 0 only turns the LRU off:
+    // requests are still shared and the disk cache still used.
+    class GeoCache
+    {
+    public:
+        using clk = std::chrono::steady_clock;
+
+        std::optional<GeoInfo> lookup(uint32_t key, const std::string &ip)
+        {
+            std::unique_lock<std::mutex> lk(mu_);
+            auto it = index_.find(key);
+            if (it != index_.end())
+            {
+                if (it->second->expires > clk::now())
+                {
+                    lru_.splice(lru_.begin(), lru_, it->second);
+                    stats_.hits++;
+                    if (!it->second->info)
+                        stats_.negative_hits++;
+                    return it->second->info;
+                }
+                lru_.erase(it->second);
+                index_.erase(it);
+            }
+
+            auto inf = inflight_.find(key);
+            if (inf != inflight_.end())
+            {
+                std::shared_ptr<Pending> p = inf->second;
+                stats_.coalesced++;
+                p->cv.wait(lk, [&] { return p->done; });
+                return p->info;
+            }
+
+            auto p = std::make_shared<Pending>();
+            inflight_.emplace(key, p);
+            const auto ttl = cfg_.ttl, negative_ttl = cfg_.negative_ttl;
+            lk.unlock();
+
+            std::optional<GeoInfo> info;
+            std::chrono::system_clock::time_point expires;
+            if (disk_.find(key, info, expires))
+            {
+                const auto left = std::chrono::duration_cast<std::chrono::seconds>(
+                    expires - std::chrono::system_clock::now());
+                complete(key, *p, info, std::min(left, info ? ttl : negative_ttl), true);
+                return info;
+            }
+
+            try
+            {
+                info = fetch(ip);
+            }
+            catch (...)
+            {
+                // transient (DNS, socket): don't cache, but release the waiters
+                complete(key, *p, std::nullopt, {}, false);
+                throw;
+            }
+            disk_.store(key, info, info ? ttl : negative_ttl);
+            complete(key, *p, info, info ? ttl : negative_ttl, false);
+            return info;
+        }
+
+        // Batched form of lookup(): cached answers first, then one POST per
+        // kBatchMax addresses that nobody else is already fetching.
+        std::vector<std::optional<GeoInfo>> lookup_many(const std::vector<std::string> &ips)
+        {
+            std::vector<std::optional<GeoInfo>> out(ips.size());
+            std::vector<uint32_t> keys(ips.size(), 0);
+            std::vector<std::shared_ptr<Pending>> own(ips.size()); // fetched by this call
+            std::vector<std::pair<std::size_t, std::shared_ptr<Pending>>> theirs;
+            std::vector<std::size_t> mine;
+
+            std::unique_lock<std::mutex> lk(mu_);
+            const auto ttl = cfg_.ttl, negative_ttl = cfg_.negative_ttl;
+            for (std::size_t i = 0; i < ips.size(); ++i)
+            {
+                in_addr a{};
+                if (inet_pton(AF_INET, ips[i].c_str(), &a) == 1)
+                    keys[i] = ntohl(a.s_addr);
+                if (keys[i] == 0)
+                {
+                    stats_.misses++;
+                    mine.push_back(i);
+                    continue;
+                }
+                auto it = index_.find(keys[i]);
+                if (it != index_.end() && it->second->expires > clk::now())
+                {
+                    lru_.splice(lru_.begin(), lru_, it->second);
+                    stats_.hits++;
+                    if (!it->second->info)
+                        stats_.negative_hits++;
+                    out[i] = it->second->info;
+                    continue;
+                }
+                // in flight elsewhere, or a repeat within this batch
+                auto inf = inflight_.find(keys[i]);
+                if (inf != inflight_.end())
+                {
+                    stats_.coalesced++;
+                    theirs.emplace_back(i, inf->second);
+                    continue;
+                }
+                own[i] = std::make_shared<Pending>();
+                inflight_.emplace(keys[i], own[i]);
+                mine.push_back(i);
+            }
+            lk.unlock();
+
+            std::vector<std::size_t> net;
+            for (std::size_t i : mine)
+            {
+                std::chrono::system_clock::time_point expires;
+                if (own[i] && disk_.find(keys[i], out[i], expires))
+                {
+                    const auto left = std::chrono::duration_cast<std::chrono::seconds>(
+                        expires - std::chrono::system_clock::now());
+                    complete(keys[i], *own[i], out[i], std::min(left, out[i] ? ttl : negative_ttl), true);
+                }
+                else
+                    net.push_back(i);
+            }
+
+            std::vector<std::string> net_ips;
+            for (std::size_t i : net)
+                net_ips.push_back(ips[i]);
+            std::vector<char> ok;
+            std::vector<std::optional<GeoInfo>> res;
+            try
+            {
+                if (!net.empty())
+                    res = fetch_batch(net_ips, ok);
+            }
+            catch (...)
+            {
+                for (std::size_t i : net)
+                    if (own[i])
+                        complete(keys[i], *own[i], std::nullopt, {}, false);
+                throw;
+            }
+            for (std::size_t k = 0; k < net.size(); ++k)
+            {
+                const std::size_t i = net[k];
+                out[i] = std::move(res[k]);
+                if (!own[i])
+                    continue;
+                // a failed request says nothing about the address: don't cache it
+                const auto t = ok[k] ? (out[i] ? ttl : negative_ttl) : std::chrono::seconds{};
+                if (ok[k])
+                    disk_.store(keys[i], out[i], t);
+                complete(keys[i], *own[i], out[i], t, false);
+            }
+
+            for (auto &[i, p] : theirs)
+            {
+                lk.lock();
+                p->cv.wait(lk, [&] { return p->done; });
+                out[i] = p->info;
+                lk.unlock();
+            }
+            return out;
+        }
+
+        void configure(const GeoCacheConfig &cfg)
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            cfg_ = cfg;
+            lru_.clear();
+            index_.clear();
+        }
+
+        GeoCacheStats stats()
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            return stats_;
+        }
+
+        void use_disk(const std::string &path)
+        {
+            disk_.open(path);
+        }
+
+    private:
+        struct Entry
+        {
+            uint32_t key;
+            std::optional<GeoInfo> info;
+            clk::time_point expires;
+        };
+        struct Pending
+        {
+            std::condition_variable cv;
+            bool done = false;
+            std::optional<GeoInfo> info;
+        };
+
+        // Publish a finished lookup to the LRU (for `ttl`, if positive) and
+        // to anyone waiting on it.
+        void complete(uint32_t key, Pending &p, const std::optional<GeoInfo> &info, std::chrono::seconds ttl,
+                      bool disk_hit)
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            (disk_hit ? stats_.disk_hits : stats_.misses)++;
+            if (ttl.count() > 0 && cfg_.capacity > 0)
+            {
+                auto old = index_.find(key);
+                if (old != index_.end())
+                    lru_.erase(old->second);
+                lru_.push_front(Entry{key, info, clk::now() + ttl});
+                index_[key] = lru_.begin();
+                while (lru_.size() > cfg_.capacity)
+                {
+                    index_.erase(lru_.back().key);
+                    lru_.pop_back();
+                    stats_.evictions++;
+                }
+            }
+            inflight_.erase(key);
+            p.info = info;
+            p.done = true;
+            p.cv.notify_all();
+        }
+
+        std::mutex mu_;
+        GeoCacheConfig cfg_;
+        std::list<Entry> lru_; // most recently used first
+        std::unordered_map<uint32_t, std::list<Entry>::iterator> index_;
+        std::unordered_map<uint32_t, std::shared_ptr<Pending>> inflight_;
+        GeoCacheStats stats_;
+        GeoCacheFile disk_;
+    };
+
+    static GeoCache &cache()
+    {
+        static GeoCache c;
+        return c;
+    }
+
+    // Local MaxMind databases (e.g. a City and an ASN one), consulted before
+    // anything else; fields from all of them are merged.
+    class OfflineGeo
+    {
+    public:
+        void add(const std::string &path)
+        {
+            dbs_.push_back(std::make_unique<MmdbReader>(path));
         }
-        return {};
+
+        bool lookup(const std::string &ip, std::optional<GeoInfo> &out) const
+        {
+            in_addr a{};
+            if (dbs_.empty() || inet_pton(AF_INET, ip.c_str(), &a) != 1)
+                return false;
+            bool any = false;
+            GeoInfo g{};
+            MmdbReader::Record r;
+            for (const auto &db : dbs_)
+            {
+                if (!db->lookup(ntohl(a.s_addr), r))
+                    continue;
+                any = true;
+                if (g.city.empty())
+                    g.city.assign(r.city);
+                if (g.country.empty())
+                    g.country.assign(r.country);
+                if (r.has_location && g.lat == 0.0 && g.lon == 0.0)
+                {
+                    g.lat = r.lat;
+                    g.lon = r.lon;
+                }
+                if (r.asn && g.asn.empty())
+                {
+                    g.asn = "AS" + std::to_string(r.asn);
+                    g.org.assign(r.as_org);
+                    g.as_text = g.org.empty() ? g.asn : g.asn + " " + g.org;
+                }
+            }
+            if (!any)
+                return false;
+            g.ip = ip;
+            out = std::move(g);
+            return true;
+        }
+
+    private:
+        std::vector<std::unique_ptr<MmdbReader>> dbs_;
+    };
+
+    static OfflineGeo &offline()
+    {
+        static OfflineGeo o;
+        return o;
+    }
+
+    // IANA special-purpose space (private, CGNAT, loopback, documentation,
+    // ...): nothing anyone could geolocate, so never worth a request
+    static PrefixClassifier &local_prefixes()
+    {
+        static PrefixClassifier t(PrefixClassifier::Preset::SpecialPurpose);
+        return t;
+    }
+
+    const PrefixClassifier::Label *GeoResolver::local_prefix(uint32_t ip)
+    {
+        return local_prefixes().classify(ip);
     }
 
-    static std::string extract_body(const std::string &resp)
+    const PrefixClassifier::Label *GeoResolver::local_prefix(const std::string &ip)
     {
-        auto p = resp.find("\r\n\r\n");
+        return local_prefixes().classify(ip);
+    }
 
-        if (p == std::string::npos)
-            return resp;
-        return resp.substr(p + 4);
+    void GeoResolver::add_local_prefix(std::string_view cidr, std::string label)
+    {
+        local_prefixes().add(cidr, std::move(label));
     }
 
     std::optional<GeoInfo> GeoResolver::lookup(const std::string &ip)
     {
-        const std::string host = "ip-api.com";
-        // include ASN/ISP/org fields
-        const std::string path = "/json/" + ip + "?fields=status,country,city,lat,lon,isp,org,as,asname";
-        std::string resp = http_get(host, path);
-        if (resp.empty())
+        if (local_prefix(ip))
             return std::nullopt;
-        std::string body = extract_body(resp);
+        std::optional<GeoInfo> g;
+        if (offline().lookup(ip, g))
+            return g;
+        in_addr a{};
+        if (inet_pton(AF_INET, ip.c_str(), &a) != 1)
+            return fetch(ip); // not a dotted quad: nothing to key on
+        return cache().lookup(ntohl(a.s_addr), ip);
+    }
+
+    std::vector<std::optional<GeoInfo>> GeoResolver::lookup_many(const std::vector<std::string> &ips)
+    {
+        std::vector<std::optional<GeoInfo>> out(ips.size());
+        std::vector<std::string> rest;
+        std::vector<std::size_t> where;
+        for (std::size_t i = 0; i < ips.size(); ++i)
+            if (!local_prefix(ips[i]) && !offline().lookup(ips[i], out[i]))
+            {
+                rest.push_back(ips[i]);
+                where.push_back(i);
+            }
+        if (rest.empty())
+            return out;
+        auto online = cache().lookup_many(rest);
+        for (std::size_t k = 0; k < rest.size(); ++k)
+            out[where[k]] = std::move(online[k]);
+        return out;
+    }
+
+    void GeoResolver::use_offline_db(const std::string &path)
+    {
+        offline().add(path);
+    }
 
-        if (body.find("\"status\":\"success\"") == std::string::npos)
+    void GeoResolver::configure_cache(const GeoCacheConfig &cfg)
+    {
+        cache().configure(cfg);
+    }
+
+    void GeoResolver::use_disk_cache(const std::string &path)
+    {
+        cache().use_disk(path);
+    }
+
+    void GeoResolver::use_ip_api_host(const std::string &host, uint16_t port)
+    {
+        ip_api_client() = std::make_unique<HttpClient>(host, port);
+    }
+
+    GeoCacheStats GeoResolver::cache_stats()
+    {
+        return cache().stats();
+    }
+
+    GeoLookupQueue::GeoLookupQueue(Done done, std::size_t workers) : done_(std::move(done))
+    {
+        for (std::size_t i = 0; i < std::max<std::size_t>(workers, 1); ++i)
+            threads_.emplace_back([this] { work(); });
+    }
+
+    GeoLookupQueue::~GeoLookupQueue()
+    {
         {
-            return std::nullopt;
+            std::lock_guard<std::mutex> lk(mu_);
+            stop_ = true;
         }
+        cv_.notify_all();
+        for (auto &t : threads_)
+            t.join();
+    }
 
-        GeoInfo g{};
-        g.ip = ip;
-        std::smatch m;
-        auto grab = [&](const std::regex &re)
-        { return std::regex_search(body, m, re) ? m[1].str() : std::string(); };
-
-        g.country = grab(std::regex("\"country\":\"([^\"]*)\""));
-        g.city = grab(std::regex("\"city\":\"([^\"]*)\""));
-        std::string slat = grab(std::regex("\"lat\":([-0-9.]+)"));
-        std::string slon = grab(std::regex("\"lon\":([-0-9.]+)"));
-        if (!slat.empty())
-            g.lat = std::stod(slat);
-        if (!slon.empty())
-            g.lon = std::stod(slon);
-        g.isp = grab(std::regex("\"isp\":\"([^\"]*)\""));
-        g.org = grab(std::regex("\"org\":\"([^\"]*)\""));
-        g.as_text = grab(std::regex("\"as\":\"([^\"]*)\""));
-        g.as_name = grab(std::regex("\"asname\":\"([^\"]*)\""));
-
-        // Extract "ASnnnnn" prefix from as_text
-        std::smatch am;
-        if (std::regex_search(g.as_text, am, std::regex("(AS\\d+)")))
-            g.asn = am[1];
+    void GeoLookupQueue::submit(std::string ip)
+    {
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            queue_.push_back(std::move(ip));
+        }
+        cv_.notify_one();
+    }
 
-        return g;
+    void GeoLookupQueue::wait()
+    {
+        std::unique_lock<std::mutex> lk(mu_);
+        idle_cv_.wait(lk, [&] { return queue_.empty() && running_ == 0; });
+    }
+
+    void GeoLookupQueue::work()
+    {
+        std::unique_lock<std::mutex> lk(mu_);
+        for (;;)
+        {
+            cv_.wait(lk, [&] { return stop_ || !queue_.empty(); });
+            if (queue_.empty())
+                return; // stopping, and nothing left to answer
+
+            // everything queued so far, up to one /batch request
+            const std::size_t n = std::min(queue_.size(), kBatchMax);
+            std::vector<std::string> ips(std::make_move_iterator(queue_.begin()),
+                                         std::make_move_iterator(queue_.begin() + n));
+            queue_.erase(queue_.begin(), queue_.begin() + n);
+            running_++;
+            lk.unlock();
+
+            std::vector<std::optional<GeoInfo>> infos;
+            try
+            {
+                infos = GeoResolver::lookup_many(ips);
+            }
+            catch (const std::exception &)
+            {
+                infos.assign(ips.size(), std::nullopt); // e.g. ip-api.com didn't resolve
+            }
+            for (std::size_t i = 0; i < ips.size(); ++i)
+                done_(ips[i], infos[i]);
+
+            lk.lock();
+            running_--;
+            if (queue_.empty() && running_ == 0)
+                idle_cv_.notify_all();
+        }
     }
 } // namespace geo
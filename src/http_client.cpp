@@ -0,0 +1,335 @@
+// ===================== File: src/http_client.cpp =====================
+#include "http_client.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <string_view>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+namespace geo {
+
+namespace {
+constexpr int kIoTimeoutSec = 5;          // connect, send and each recv
+constexpr std::size_t kMaxHead = 64 << 10; // status line + headers
+
+bool iequals(std::string_view a, std::string_view b) {
+    if (a.size() != b.size())
+        return false;
+    for (std::size_t i = 0; i < a.size(); ++i)
+        if ((a[i] | 0x20) != (b[i] | 0x20))
+            return false;
+    return true;
+}
+
+// case-insensitive token search in a header value ("keep-alive, Upgrade")
+bool icontains(std::string_view hay, std::string_view needle) {
+    for (std::size_t i = 0; i + needle.size() <= hay.size(); ++i)
+        if (iequals(hay.substr(i, needle.size()), needle))
+            return true;
+    return false;
+}
+
+std::string_view trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t'))
+        s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t'))
+        s.remove_suffix(1);
+    return s;
+}
+} // namespace
+
+struct HttpClient::Conn {
+    int fd = -1;
+    std::string buf; // received, not yet consumed
+
+    ~Conn() {
+        if (fd >= 0)
+            ::close(fd);
+    }
+
+    bool send_all(const std::string& data) const {
+        std::size_t off = 0;
+        while (off < data.size()) {
+            // MSG_NOSIGNAL: a pooled connection the server already closed
+            // must fail the send, not kill the process
+            const ssize_t n = ::send(fd, data.data() + off, data.size() - off, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            off += static_cast<std::size_t>(n);
+        }
+        return true;
+    }
+
+    bool fill() {
+        char tmp[16384];
+        for (;;) {
+            const ssize_t n = ::recv(fd, tmp, sizeof(tmp), 0);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            buf.append(tmp, static_cast<std::size_t>(n));
+            return true;
+        }
+    }
+
+    // Idle connection still usable: nothing unread and not closed by the peer
+    bool alive() const {
+        char c;
+        const ssize_t n = ::recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+        return buf.empty() && n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    }
+
+    // Offset of the "\r\n" ending the line at `pos`, reading more as needed
+    bool line_end(std::size_t pos, std::size_t& eol) {
+        while ((eol = buf.find("\r\n", pos)) == std::string::npos)
+            if (buf.size() - pos > kMaxHead || !fill())
+                return false;
+        return true;
+    }
+
+    bool read_chunked(std::size_t& pos, std::string& body) {
+        for (;;) {
+            std::size_t eol;
+            if (!line_end(pos, eol))
+                return false;
+            std::size_t size = 0; // hex; any ";ext" after it is ignored
+            if (std::from_chars(buf.data() + pos, buf.data() + eol, size, 16).ec != std::errc())
+                return false;
+            pos = eol + 2;
+            if (size == 0) {
+                // trailer fields, up to the empty line
+                for (;;) {
+                    if (!line_end(pos, eol))
+                        return false;
+                    const bool last = eol == pos;
+                    pos = eol + 2;
+                    if (last)
+                        return true;
+                }
+            }
+            while (buf.size() < pos + size + 2)
+                if (!fill())
+                    return false;
+            body.append(buf, pos, size);
+            pos += size + 2;
+        }
+    }
+
+    // One response off the front of `buf`. `keep` is false if the
+    // connection can't carry another request afterwards.
+    bool read_response(HttpResponse& out, bool& keep) {
+        for (;;) {
+            std::size_t head_end;
+            while ((head_end = buf.find("\r\n\r\n")) == std::string::npos)
+                if (buf.size() > kMaxHead || !fill())
+                    return false;
+            const std::string_view head(buf.data(), head_end);
+            if (head.size() < 12 || head.compare(0, 5, "HTTP/") != 0)
+                return false;
+            int status = 0;
+            if (std::from_chars(head.data() + 9, head.data() + 12, status).ec != std::errc())
+                return false;
+            keep = head.compare(0, 8, "HTTP/1.0") != 0;
+
+            long long length = -1;
+            bool chunked = false;
+            for (std::size_t p = head.find("\r\n"); p != std::string_view::npos && p < head.size();) {
+                const std::size_t q = std::min(head.find("\r\n", p + 2), head.size());
+                const std::string_view line = head.substr(p + 2, q - p - 2);
+                p = q;
+                const std::size_t colon = line.find(':');
+                if (colon == std::string_view::npos)
+                    continue;
+                const std::string_view name = trim(line.substr(0, colon)), value = trim(line.substr(colon + 1));
+                if (iequals(name, "content-length")) {
+                    if (std::from_chars(value.data(), value.data() + value.size(), length).ec != std::errc() ||
+                        length < 0) // unrecoverable framing error (RFC 9112 6.3)
+                        return false;
+                } else if (iequals(name, "transfer-encoding")) {
+                    chunked = icontains(value, "chunked");
+                } else if (iequals(name, "connection")) {
+                    if (icontains(value, "close"))
+                        keep = false;
+                    else if (icontains(value, "keep-alive"))
+                        keep = true;
+                }
+            }
+
+            std::size_t pos = head_end + 4;
+            if (status >= 100 && status < 200) { // 100 Continue and friends
+                buf.erase(0, pos);
+                continue;
+            }
+            out.body.clear();
+            if (status == 204 || status == 304) {
+                // no body
+            } else if (chunked) {
+                if (!read_chunked(pos, out.body))
+                    return false;
+            } else if (length >= 0) {
+                const auto n = static_cast<std::size_t>(length);
+                while (buf.size() - pos < n)
+                    if (!fill())
+                        return false;
+                out.body.assign(buf, pos, n);
+                pos += n;
+            } else {
+                while (fill()) {
+                }
+                out.body.assign(buf, pos, std::string::npos);
+                pos = buf.size();
+                keep = false;
+            }
+            buf.erase(0, pos);
+            out.status = status;
+            return true;
+        }
+    }
+};
+
+HttpClient::HttpClient(std::string host, uint16_t port, std::size_t max_idle)
+    : host_(std::move(host)), port_(port), max_idle_(max_idle) {}
+
+HttpClient::~HttpClient() = default;
+
+HttpClient::Stats HttpClient::stats() const {
+    std::lock_guard<std::mutex> lk(mu_);
+    return stats_;
+}
+
+std::unique_ptr<HttpClient::Conn> HttpClient::connect() {
+    std::vector<ResolvedAddress> addrs;
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        addrs = addrs_;
+    }
+    // cached addresses first; if none of them answers, resolve again once
+    for (int pass = 0; pass < 2; ++pass) {
+        const bool fresh = addrs.empty();
+        if (fresh)
+            addrs = DNSResolver::resolve(host_, port_);
+        for (const auto& ra : addrs) {
+            auto c = std::make_unique<Conn>();
+            c->fd = ::socket(ra.family, ra.socktype | SOCK_CLOEXEC, ra.protocol);
+            if (c->fd < 0)
+                continue;
+            const timeval tv{kIoTimeoutSec, 0};
+            ::setsockopt(c->fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)); // also bounds connect()
+            ::setsockopt(c->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            const int one = 1;
+            ::setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            if (::connect(c->fd, reinterpret_cast<const sockaddr*>(&ra.addr), ra.addrlen) != 0)
+                continue;
+            std::lock_guard<std::mutex> lk(mu_);
+            if (fresh)
+                addrs_ = addrs;
+            stats_.connects++;
+            return c;
+        }
+        if (fresh)
+            break;
+        addrs.clear();
+    }
+    return nullptr;
+}
+
+std::unique_ptr<HttpClient::Conn> HttpClient::checkout(bool& reused) {
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        while (!idle_.empty()) {
+            auto c = std::move(idle_.back());
+            idle_.pop_back();
+            if (c->alive()) {
+                reused = true;
+                stats_.reused++;
+                return c;
+            }
+        }
+    }
+    reused = false;
+    return connect();
+}
+
+void HttpClient::checkin(std::unique_ptr<Conn> c) {
+    std::lock_guard<std::mutex> lk(mu_);
+    if (idle_.size() < max_idle_)
+        idle_.push_back(std::move(c));
+}
+
+void HttpClient::append_request(std::string& wire, const HttpRequest& req) const {
+    wire += req.method;
+    wire += ' ';
+    wire += req.path;
+    wire += " HTTP/1.1\r\nHost: ";
+    wire += host_;
+    wire += "\r\n";
+    if (!req.content_type.empty()) {
+        wire += "Content-Type: ";
+        wire += req.content_type;
+        wire += "\r\n";
+    }
+    if (!req.body.empty() || req.method == "POST") {
+        wire += "Content-Length: ";
+        wire += std::to_string(req.body.size());
+        wire += "\r\n";
+    }
+    wire += "\r\n";
+    wire += req.body;
+}
+
+HttpResponse HttpClient::request(const HttpRequest& req) {
+    return std::move(pipeline({req}).front());
+}
+
+std::vector<HttpResponse> HttpClient::pipeline(const std::vector<HttpRequest>& reqs) {
+    std::vector<HttpResponse> out(reqs.size());
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        stats_.requests += reqs.size();
+    }
+    std::size_t done = 0;
+    while (done < reqs.size()) {
+        bool reused = false;
+        auto c = checkout(reused);
+        if (!c)
+            break;
+        std::string wire;
+        for (std::size_t k = done; k < reqs.size(); ++k)
+            append_request(wire, reqs[k]);
+
+        const std::size_t before = done;
+        bool keep = c->send_all(wire);
+        while (keep && done < reqs.size()) {
+            if (!c->read_response(out[done], keep)) {
+                out[done] = HttpResponse{};
+                keep = false;
+                break;
+            }
+            ++done;
+        }
+        if (keep && c->buf.empty())
+            checkin(std::move(c));
+
+        // a pooled connection the server had dropped: resend on another one
+        // (the requests here are lookups, safe to repeat). A new connection
+        // that answers nothing means the server is down.
+        if (done == before) {
+            if (!reused)
+                break;
+            std::lock_guard<std::mutex> lk(mu_);
+            stats_.retries++;
+        }
+    }
+    return out;
+}
+
+} // namespace geo
@@ -2,11 +2,10 @@
 #include "icmp_listener.hpp"
 
 #include <arpa/inet.h>
-#include <array>
+#include <chrono>
 #include <cstring>
 #include "net_compat.hpp"
 #include <optional>
-#include <string>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -19,9 +18,11 @@ namespace geo
         if (fd_ != -1)
             return true;
 
+        raw_ = false;
         if (mode == OpenMode::RawOnly)
         {
             fd_ = ::socket(AF_INET, SOCK_RAW, IPPROTO_ICMP);
+            raw_ = true;
         }
         else if (mode == OpenMode::DatagramOnly)
         {
@@ -32,6 +33,7 @@ namespace geo
         { // Auto
             // Try raw first for assignment compliance
             fd_ = ::socket(AF_INET, SOCK_RAW, IPPROTO_ICMP);
+            raw_ = fd_ >= 0;
             if (fd_ < 0)
             {
                 // Fallback: NAT-friendly kernel ICMP
@@ -44,6 +46,9 @@ namespace geo
 
         struct timeval tv{1, 0};
         setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        // best effort: without it rx_time falls back to when we drained
+        (void)enable_rx_timestamps(fd_);
+        batch_.reserve(RecvRing::kSlots);
         return true;
     }
 
@@ -56,42 +61,69 @@ namespace geo
         }
     }
 
-    std::optional<IcmpListener::TimeExceeded> IcmpListener::recv_time_exceeded()
+    std::optional<IcmpListener::TimeExceeded> IcmpListener::recv_time_exceeded(uint8_t *buf, std::size_t cap)
     {
-        std::array<uint8_t, 2048> buf{};
         sockaddr_in from{};
         socklen_t flen = sizeof(from);
-        ssize_t n = ::recvfrom(fd_, buf.data(), buf.size(), 0, reinterpret_cast<sockaddr *>(&from), &flen);
+        ssize_t n = ::recvfrom(fd_, buf, cap, 0, reinterpret_cast<sockaddr *>(&from), &flen);
         if (n <= 0)
             return std::nullopt;
 
-        auto *ip_outer = reinterpret_cast<iphdr *>(buf.data());
+        auto te = parse_time_exceeded(buf, static_cast<size_t>(n));
+        if (te)
+            te->rx_time = std::chrono::steady_clock::now();
+        return te;
+    }
+
+    const std::vector<IcmpListener::TimeExceeded> &IcmpListener::recv_time_exceeded_batch()
+    {
+        batch_.clear();
+        int n = ring_.drain(fd_);
+        for (int i = 0; i < n; ++i)
+        {
+            auto te = parse_time_exceeded(ring_.data(i), ring_.len(i));
+            if (!te)
+                continue;
+            te->rx_time = ring_.received_at(i);
+            batch_.push_back(*te);
+        }
+        return batch_;
+    }
+
+    std::optional<IcmpListener::TimeExceeded> IcmpListener::parse_time_exceeded(const uint8_t *buf, size_t n)
+    {
+        if (n < sizeof(iphdr))
+            return std::nullopt;
+        auto *ip_outer = reinterpret_cast<const iphdr *>(buf);
         size_t off = ip_outer->ihl * 4;
-        if (off + sizeof(icmphdr) > static_cast<size_t>(n))
+        if (off + sizeof(icmphdr) > n)
             return std::nullopt;
-        auto *icmp = reinterpret_cast<icmphdr *>(buf.data() + off);
+        auto *icmp = reinterpret_cast<const icmphdr *>(buf + off);
         if (icmp->type != ICMP_TIME_EXCEEDED)
             return std::nullopt;
 
         size_t inner_off = off + sizeof(icmphdr);
-        if (inner_off + sizeof(iphdr) + 8 > static_cast<size_t>(n))
+        if (inner_off + sizeof(iphdr) + 8 > n)
             return std::nullopt;
-        auto *ip_inner = reinterpret_cast<iphdr *>(buf.data() + inner_off);
+        auto *ip_inner = reinterpret_cast<const iphdr *>(buf + inner_off);
         size_t tcp_off = inner_off + ip_inner->ihl * 4;
-        if (tcp_off + 8 > static_cast<size_t>(n))
+        if (tcp_off + 8 > n)
             return std::nullopt;
 
-        uint16_t sport = ntohs(*reinterpret_cast<uint16_t *>(buf.data() + tcp_off + 0));
-        // uint16_t dport = ntohs(*reinterpret_cast<uint16_t*>(buf.data() + tcp_off + 2));
-
-        char ipbuf[INET_ADDRSTRLEN];
-        if (!inet_ntop(AF_INET, &ip_outer->saddr, ipbuf, sizeof(ipbuf)))
-            return std::nullopt;
+        uint16_t sport, dport;
+        uint32_t seq;
+        std::memcpy(&sport, buf + tcp_off + 0, sizeof(sport));
+        std::memcpy(&dport, buf + tcp_off + 2, sizeof(dport));
+        std::memcpy(&seq, buf + tcp_off + 4, sizeof(seq));
 
         TimeExceeded te{};
-        te.from_ip = ipbuf;
-        te.orig_sport = sport;
+        te.from_addr = ip_outer->saddr;
+        te.orig_sport = ntohs(sport);
         te.orig_ttl = ip_inner->ttl;
+        te.orig_dst = ip_inner->daddr;
+        te.orig_dport = ntohs(dport);
+        te.orig_ip_id = ntohs(ip_inner->id);
+        te.orig_seq = ntohl(seq);
         return te;
     }
 
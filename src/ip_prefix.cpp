@@ -0,0 +1,240 @@
+// ===================== File: src/ip_prefix.cpp =====================
+#include "ip_prefix.hpp"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+
+namespace geo {
+
+namespace {
+using Kind = PrefixClassifier::Kind;
+
+struct Entry {
+    const char* cidr;
+    const char* label;
+    Kind kind;
+};
+
+// IANA IPv4 Special-Purpose Address Registry, plus multicast
+constexpr Entry kSpecial4[] = {
+    {"0.0.0.0/8", "This network", Kind::Reserved},
+    {"10.0.0.0/8", "Private-Use (RFC 1918)", Kind::Local},
+    {"100.64.0.0/10", "Shared Address Space / CGNAT", Kind::Local},
+    {"127.0.0.0/8", "Loopback", Kind::Reserved},
+    {"169.254.0.0/16", "Link-Local", Kind::Local},
+    {"172.16.0.0/12", "Private-Use (RFC 1918)", Kind::Local},
+    {"192.0.0.0/24", "IETF Protocol Assignments", Kind::Reserved},
+    {"192.0.0.0/29", "IPv4 Service Continuity (DS-Lite)", Kind::Reserved},
+    {"192.0.0.8/32", "IPv4 Dummy Address", Kind::Reserved},
+    {"192.0.0.9/32", "Port Control Protocol Anycast", Kind::Reserved},
+    {"192.0.0.10/32", "TURN Anycast", Kind::Reserved},
+    {"192.0.0.170/31", "NAT64/DNS64 Discovery", Kind::Reserved},
+    {"192.0.2.0/24", "Documentation (TEST-NET-1)", Kind::Reserved},
+    {"192.31.196.0/24", "AS112-v4", Kind::Reserved},
+    {"192.52.193.0/24", "AMT", Kind::Reserved},
+    {"192.88.99.0/24", "Deprecated 6to4 Relay Anycast", Kind::Reserved},
+    {"192.168.0.0/16", "Private-Use (RFC 1918)", Kind::Local},
+    {"192.175.48.0/24", "Direct Delegation AS112 Service", Kind::Reserved},
+    {"198.18.0.0/15", "Benchmarking", Kind::Reserved},
+    {"198.51.100.0/24", "Documentation (TEST-NET-2)", Kind::Reserved},
+    {"203.0.113.0/24", "Documentation (TEST-NET-3)", Kind::Reserved},
+    {"224.0.0.0/4", "Multicast", Kind::Reserved},
+    {"240.0.0.0/4", "Reserved", Kind::Reserved},
+    {"255.255.255.255/32", "Limited Broadcast", Kind::Reserved},
+};
+
+// IANA IPv6 Special-Purpose Address Registry, plus multicast
+constexpr Entry kSpecial6[] = {
+    {"::/128", "Unspecified Address", Kind::Reserved},
+    {"::1/128", "Loopback", Kind::Reserved},
+    {"64:ff9b::/96", "IPv4-IPv6 Translation", Kind::Reserved},
+    {"64:ff9b:1::/48", "Local-Use IPv4/IPv6 Translation", Kind::Reserved},
+    {"100::/64", "Discard-Only", Kind::Reserved},
+    {"2001::/23", "IETF Protocol Assignments", Kind::Reserved},
+    {"2001::/32", "Teredo", Kind::Reserved},
+    {"2001:1::1/128", "Port Control Protocol Anycast", Kind::Reserved},
+    {"2001:1::2/128", "TURN Anycast", Kind::Reserved},
+    {"2001:1::3/128", "DNS-SD Service Registration Protocol Anycast", Kind::Reserved},
+    {"2001:2::/48", "Benchmarking", Kind::Reserved},
+    {"2001:3::/32", "AMT", Kind::Reserved},
+    {"2001:4:112::/48", "AS112-v6", Kind::Reserved},
+    {"2001:10::/28", "Deprecated (ORCHID)", Kind::Reserved},
+    {"2001:20::/28", "ORCHIDv2", Kind::Reserved},
+    {"2001:30::/28", "Drone Remote ID Protocol Entity Tags", Kind::Reserved},
+    {"2001:db8::/32", "Documentation", Kind::Reserved},
+    {"2002::/16", "6to4", Kind::Reserved},
+    {"2620:4f:8000::/48", "Direct Delegation AS112 Service", Kind::Reserved},
+    {"3fff::/20", "Documentation", Kind::Reserved},
+    {"5f00::/16", "Segment Routing (SRv6) SIDs", Kind::Reserved},
+    {"fc00::/7", "Unique-Local", Kind::Local},
+    {"fe80::/10", "Link-Local Unicast", Kind::Local},
+    {"ff00::/8", "Multicast", Kind::Reserved},
+};
+
+using Addr6 = std::pair<uint64_t, uint64_t>;
+
+uint32_t mask(uint32_t a, int len) { return len == 0 ? 0 : a & (~0u << (32 - len)); }
+uint32_t last(uint32_t net, int len) { return len == 0 ? ~0u : net | ~(~0u << (32 - len)); }
+bool is_max(uint32_t a) { return a == ~0u; }
+uint32_t succ(uint32_t a) { return a + 1; }
+
+Addr6 mask(const Addr6& a, int len) {
+    if (len <= 64)
+        return {len == 0 ? 0 : a.first & (~0ull << (64 - len)), 0};
+    return {a.first, a.second & (~0ull << (128 - len))};
+}
+Addr6 last(const Addr6& net, int len) {
+    if (len <= 64)
+        return {len == 0 ? ~0ull : net.first | ~(~0ull << (64 - len)), ~0ull};
+    return {net.first, net.second | ~(~0ull << (128 - len))};
+}
+bool is_max(const Addr6& a) { return a.first == ~0ull && a.second == ~0ull; }
+Addr6 succ(const Addr6& a) { return a.second == ~0ull ? Addr6{a.first + 1, 0} : Addr6{a.first, a.second + 1}; }
+
+Addr6 to_addr6(const in6_addr& a) {
+    uint64_t hi = 0, lo = 0;
+    for (int i = 0; i < 8; ++i) {
+        hi = (hi << 8) | a.s6_addr[i];
+        lo = (lo << 8) | a.s6_addr[i + 8];
+    }
+    return {hi, lo};
+}
+
+// inet_pton wants a NUL-terminated string
+bool copy_z(std::string_view s, char (&buf)[INET6_ADDRSTRLEN]) {
+    if (s.size() >= sizeof(buf))
+        return false;
+    std::memcpy(buf, s.data(), s.size());
+    buf[s.size()] = '\0';
+    return true;
+}
+} // namespace
+
+template <class K>
+void PrefixClassifier::Table<K>::compile() {
+    dirty = false;
+    // every point where the longest match can change
+    std::vector<K> bounds{K{}};
+    for (const auto& p : prefixes) {
+        bounds.push_back(p.net);
+        const K end = last(p.net, p.len);
+        if (!is_max(end))
+            bounds.push_back(succ(end));
+    }
+    std::sort(bounds.begin(), bounds.end());
+    bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+
+    starts.clear();
+    labels.clear();
+    for (const K& b : bounds) {
+        int best = -1, best_len = -1;
+        for (const auto& p : prefixes)
+            if (p.len >= best_len && !(b < p.net) && !(last(p.net, p.len) < b)) {
+                best = p.label; // later add() of the same prefix wins
+                best_len = p.len;
+            }
+        if (!labels.empty() && labels.back() == best)
+            continue; // same answer as the range before: merge
+        starts.push_back(b);
+        labels.push_back(best);
+    }
+}
+
+template <class K>
+int PrefixClassifier::Table<K>::find(K key) const {
+    const auto it = std::upper_bound(starts.begin(), starts.end(), key);
+    return it == starts.begin() ? -1 : labels[static_cast<std::size_t>(it - starts.begin() - 1)];
+}
+
+PrefixClassifier::PrefixClassifier(Preset preset) {
+    if (preset != Preset::SpecialPurpose)
+        return;
+    for (const Entry& e : kSpecial4)
+        add(e.cidr, e.label, e.kind);
+    for (const Entry& e : kSpecial6)
+        add(e.cidr, e.label, e.kind);
+}
+
+void PrefixClassifier::add(std::string_view cidr, std::string label, Kind kind) {
+    const std::size_t slash = cidr.find('/');
+    const std::string_view addr = cidr.substr(0, slash);
+    char buf[INET6_ADDRSTRLEN];
+    if (!copy_z(addr, buf))
+        throw std::invalid_argument("bad prefix: " + std::string(cidr));
+
+    in_addr a4{};
+    in6_addr a6{};
+    const bool v4 = inet_pton(AF_INET, buf, &a4) == 1;
+    if (!v4 && inet_pton(AF_INET6, buf, &a6) != 1)
+        throw std::invalid_argument("bad prefix: " + std::string(cidr));
+    const int max_len = v4 ? 32 : 128;
+    int len = max_len;
+    if (slash != std::string_view::npos) {
+        const std::string_view l = cidr.substr(slash + 1);
+        const auto r = std::from_chars(l.data(), l.data() + l.size(), len);
+        if (l.empty() || r.ec != std::errc() || r.ptr != l.data() + l.size() || len < 0 || len > max_len)
+            throw std::invalid_argument("bad prefix length: " + std::string(cidr));
+    }
+
+    // reuse the slot of an identical label so the table stays small
+    const auto same = std::find_if(labels_.begin(), labels_.end(),
+                                   [&](const Label& l) { return l.name == label && l.kind == kind; });
+    const int id = static_cast<int>(same - labels_.begin());
+    if (same == labels_.end())
+        labels_.push_back({std::move(label), kind});
+
+    if (v4) {
+        v4_.prefixes.push_back({mask(ntohl(a4.s_addr), len), len, id});
+        v4_.dirty = true;
+    } else {
+        v6_.prefixes.push_back({mask(to_addr6(a6), len), len, id});
+        v6_.dirty = true;
+    }
+    dirty_.store(true, std::memory_order_release);
+}
+
+void PrefixClassifier::compile() const {
+    if (!dirty_.load(std::memory_order_acquire))
+        return;
+    std::lock_guard<std::mutex> lk(compile_mu_);
+    if (!dirty_.load(std::memory_order_relaxed))
+        return; // another classify() got here first
+    if (v4_.dirty)
+        v4_.compile();
+    if (v6_.dirty)
+        v6_.compile();
+    dirty_.store(false, std::memory_order_release);
+}
+
+const PrefixClassifier::Label* PrefixClassifier::classify(uint32_t ip) const {
+    compile();
+    const int id = v4_.find(ip);
+    return id < 0 ? nullptr : &labels_[static_cast<std::size_t>(id)];
+}
+
+const PrefixClassifier::Label* PrefixClassifier::classify(const in6_addr& ip) const {
+    const Addr6 a = to_addr6(ip);
+    if (a.first == 0 && (a.second >> 32) == 0xFFFF) // ::ffff:a.b.c.d
+        return classify(static_cast<uint32_t>(a.second));
+    compile();
+    const int id = v6_.find(a);
+    return id < 0 ? nullptr : &labels_[static_cast<std::size_t>(id)];
+}
+
+const PrefixClassifier::Label* PrefixClassifier::classify(std::string_view ip) const {
+    char buf[INET6_ADDRSTRLEN];
+    if (!copy_z(ip, buf))
+        return nullptr;
+    in_addr a4{};
+    if (inet_pton(AF_INET, buf, &a4) == 1)
+        return classify(static_cast<uint32_t>(ntohl(a4.s_addr)));
+    in6_addr a6{};
+    if (inet_pton(AF_INET6, buf, &a6) == 1)
+        return classify(a6);
+    return nullptr;
+}
+
+} // namespace geo
@@ -0,0 +1,317 @@
+// ===================== File: src/log_stat.cpp =====================
+#include "log_stat.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace geo::logstat {
+
+// ---------------------------------------------------------------------
+// RttHist
+// ---------------------------------------------------------------------
+
+namespace {
+// bucket 0: < 1 us; then 4 buckets per power of two of microseconds
+int bucket_of(double rtt_ms) {
+    const double us = rtt_ms * 1000.0;
+    if (!(us >= 1.0))
+        return 0;
+    const uint64_t u = us >= 1e18 ? UINT64_MAX : static_cast<uint64_t>(us);
+    const int msb = 63 - __builtin_clzll(u);
+    const int sub = msb >= 2 ? static_cast<int>((u >> (msb - 2)) & 3) : static_cast<int>((u << (2 - msb)) & 3);
+    return std::min(1 + msb * 4 + sub, RttHist::kBuckets - 1);
+}
+
+// [lo, hi) of bucket i, in ms
+void bucket_range(int i, double& lo, double& hi) {
+    if (i == 0) {
+        lo = 0.0;
+        hi = 0.001;
+        return;
+    }
+    const int msb = (i - 1) / 4, sub = (i - 1) % 4;
+    const double base = static_cast<double>(uint64_t{1} << msb) / 4.0;
+    lo = base * (4 + sub) / 1000.0;
+    hi = base * (5 + sub) / 1000.0;
+}
+} // namespace
+
+void RttHist::add(double rtt_ms) {
+    b_[bucket_of(rtt_ms)]++;
+    if (n_ == 0 || rtt_ms < min_) min_ = rtt_ms;
+    if (n_ == 0 || rtt_ms > max_) max_ = rtt_ms;
+    sum_ += rtt_ms;
+    n_++;
+}
+
+void RttHist::merge(const RttHist& o) {
+    if (o.n_ == 0)
+        return;
+    for (int i = 0; i < kBuckets; ++i)
+        b_[i] += o.b_[i];
+    if (n_ == 0 || o.min_ < min_) min_ = o.min_;
+    if (n_ == 0 || o.max_ > max_) max_ = o.max_;
+    sum_ += o.sum_;
+    n_ += o.n_;
+}
+
+double RttHist::quantile(double q) const {
+    if (n_ == 0)
+        return 0.0;
+    const double rank = q * static_cast<double>(n_ - 1);
+    uint64_t seen = 0;
+    for (int i = 0; i < kBuckets; ++i) {
+        if (b_[i] == 0)
+            continue;
+        if (static_cast<double>(seen + b_[i]) > rank) {
+            double lo, hi;
+            bucket_range(i, lo, hi);
+            // interpolate inside the part of the bucket we actually saw
+            lo = std::max(lo, min_);
+            hi = std::min(hi, max_);
+            const double f = (rank - static_cast<double>(seen) + 0.5) / static_cast<double>(b_[i]);
+            return lo + (hi - lo) * f;
+        }
+        seen += b_[i];
+    }
+    return max_;
+}
+
+void LogStats::merge(const LogStats& o) {
+    for (std::size_t t = 0; t < hops.size(); ++t) {
+        HopStats& h = hops[t];
+        const HopStats& x = o.hops[t];
+        h.sent += x.sent;
+        h.send_errors += x.send_errors;
+        h.icmp += x.icmp;
+        h.dest += x.dest;
+        h.silent += x.silent;
+        h.rtt.merge(x.rtt);
+    }
+    files += o.files;
+    bytes += o.bytes;
+    lines += o.lines;
+    sessions += o.sessions;
+    traces += o.traces;
+    reached += o.reached;
+    unmatched_icmp += o.unmatched_icmp;
+    orphan_replies += o.orphan_replies;
+    nat_hits += o.nat_hits;
+    dropped_lines += o.dropped_lines;
+    other += o.other;
+    malformed += o.malformed;
+}
+
+// ---------------------------------------------------------------------
+// Line scanner: pointers into the mapping only, no allocation per line
+// ---------------------------------------------------------------------
+
+namespace {
+constexpr std::size_t kStampLen = 23; // "YYYY-MM-DD HH:MM:SS.mmm"
+
+template <std::size_t N>
+bool starts(const char* p, const char* e, const char (&lit)[N]) {
+    return static_cast<std::size_t>(e - p) >= N - 1 && std::memcmp(p, lit, N - 1) == 0;
+}
+
+// Value of " key=" within [p, e), or nullptr. Fields are space separated.
+template <std::size_t N>
+const char* field(const char* p, const char* e, const char (&key)[N]) {
+    while (p < e) {
+        const char* sp = static_cast<const char*>(std::memchr(p, ' ', e - p));
+        if (!sp)
+            return nullptr;
+        p = sp + 1;
+        if (starts(p, e, key))
+            return p + N - 1;
+    }
+    return nullptr;
+}
+
+bool parse_u(const char* v, const char* e, unsigned& out) {
+    return v && std::from_chars(v, e, out).ec == std::errc();
+}
+
+bool parse_d(const char* v, const char* e, double& out) {
+    return v && std::from_chars(v, e, out).ec == std::errc();
+}
+
+struct Scanner {
+    LogStats& st;
+    std::vector<uint8_t> sport_ttl; // ttl of the last PROBE_SENT per sport, 0 = none
+
+    explicit Scanner(LogStats& s) : st(s), sport_ttl(65536, 0) {}
+
+    HopStats* hop_of_sport(unsigned sport) {
+        const uint8_t ttl = sport < sport_ttl.size() ? sport_ttl[sport] : 0;
+        if (!ttl) {
+            st.orphan_replies++;
+            return nullptr;
+        }
+        return &st.hops[ttl];
+    }
+
+    void reply(const char* p, const char* e, bool icmp) {
+        unsigned sport;
+        double rtt;
+        if (!parse_u(field(p, e, "sport="), e, sport) || !parse_d(field(p, e, "rtt_ms="), e, rtt)) {
+            st.malformed++;
+            return;
+        }
+        if (HopStats* h = hop_of_sport(sport)) {
+            (icmp ? h->icmp : h->dest)++;
+            h->rtt.add(rtt);
+        }
+    }
+
+    void line(const char* p, const char* e) {
+        st.lines++;
+        if (starts(p, e, "===")) {
+            if (starts(p, e, "=== geo_tracer diag start"))
+                st.sessions++;
+            return;
+        }
+        if (static_cast<std::size_t>(e - p) < kStampLen + 3 || p[kStampLen] != ' ' || p[kStampLen + 1] != '|') {
+            st.other++;
+            return;
+        }
+        p += kStampLen + 3;
+        if (p < e && *p == '[') { // batch mode "[host] " tag
+            const char* close = static_cast<const char*>(std::memchr(p, ']', e - p));
+            if (close && close + 1 < e)
+                p = close + 2;
+        }
+
+        unsigned ttl, sport;
+        switch (p < e ? *p : 0) {
+        case 'P':
+            if (starts(p, e, "PROBE_SENT ")) {
+                if (!parse_u(field(p, e, "ttl="), e, ttl) || !parse_u(field(p, e, "sport="), e, sport) ||
+                    ttl == 0 || ttl > 255 || sport > 65535) {
+                    st.malformed++;
+                    return;
+                }
+                st.hops[ttl].sent++;
+                sport_ttl[sport] = static_cast<uint8_t>(ttl);
+                return;
+            }
+            if (starts(p, e, "PROBE_SEND_ERR ")) {
+                if (parse_u(field(p, e, "ttl="), e, ttl) && ttl <= 255)
+                    st.hops[ttl].send_errors++;
+                else
+                    st.malformed++;
+                return;
+            }
+            break;
+        case 'I':
+            if (starts(p, e, "ICMP_TIME_EXCEEDED (unmatched)")) {
+                st.unmatched_icmp++;
+                return;
+            }
+            if (starts(p, e, "ICMP_TIME_EXCEEDED ")) {
+                reply(p, e, true);
+                return;
+            }
+            break;
+        case 'D':
+            if (starts(p, e, "DEST_REPLY ")) {
+                reply(p, e, false);
+                return;
+            }
+            if (starts(p, e, "DIAG: Only local gateway")) {
+                st.nat_hits++;
+                return;
+            }
+            break;
+        case 'N':
+            if (starts(p, e, "NO_ICMP_THIS_HOP ")) {
+                if (parse_u(field(p, e, "ttl="), e, ttl) && ttl <= 255)
+                    st.hops[ttl].silent++;
+                else
+                    st.malformed++;
+                return;
+            }
+            break;
+        case 'S':
+            if (starts(p, e, "SETUP ")) {
+                st.traces++;
+                return;
+            }
+            if (starts(p, e, "STOP: destination reached")) {
+                st.reached++;
+                return;
+            }
+            break;
+        case 'W':
+            if (starts(p, e, "WARN diag ring overflow: ")) {
+                unsigned n;
+                const char* v = p + sizeof("WARN diag ring overflow: ") - 1;
+                if (parse_u(v, e, n))
+                    st.dropped_lines += n;
+                return;
+            }
+            break;
+        default:
+            break;
+        }
+        st.other++;
+    }
+};
+} // namespace
+
+void scan_buffer(const char* data, std::size_t len, LogStats& st) {
+    Scanner sc(st);
+    const char* p = data;
+    const char* end = data + len;
+    while (p < end) {
+        // glibc's memchr is vectorized; this is where the bytes get touched
+        const char* nl = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        const char* e = nl ? nl : end;
+        const char* le = (e > p && e[-1] == '\r') ? e - 1 : e;
+        if (le > p)
+            sc.line(p, le);
+        p = e + 1;
+    }
+    st.files++;
+    st.bytes += len;
+}
+
+bool scan_file(const std::string& path, LogStats& st, std::string& err) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        err = path + ": " + std::strerror(errno);
+        return false;
+    }
+    struct stat sb{};
+    if (::fstat(fd, &sb) != 0) {
+        err = path + ": " + std::strerror(errno);
+        ::close(fd);
+        return false;
+    }
+    const std::size_t len = static_cast<std::size_t>(sb.st_size);
+    if (len == 0) {
+        ::close(fd);
+        scan_buffer("", 0, st);
+        return true;
+    }
+    void* map = ::mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        err = path + ": mmap: " + std::strerror(errno);
+        return false;
+    }
+    (void)::madvise(map, len, MADV_SEQUENTIAL);
+    (void)::madvise(map, len, MADV_WILLNEED);
+    scan_buffer(static_cast<const char*>(map), len, st);
+    ::munmap(map, len);
+    return true;
+}
+
+} // namespace geo::logstat
@@ -0,0 +1,325 @@
+// ===================== File: src/mmdb_reader.cpp =====================
+#include "mmdb_reader.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <initializer_list>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace geo {
+
+namespace {
+constexpr uint8_t kMetaMarker[] = {0xAB, 0xCD, 0xEF, 'M', 'a', 'x', 'M', 'i', 'n', 'd', '.', 'c', 'o', 'm'};
+constexpr std::size_t kMetaMaxSize = 128 * 1024;
+
+// MaxMind DB data section field types
+enum : int {
+    kPointer = 1, kString = 2, kDouble = 3, kBytes = 4, kUint16 = 5, kUint32 = 6, kMap = 7,
+    kInt32 = 8, kUint64 = 9, kUint128 = 10, kArray = 11, kContainer = 12, kEndMarker = 13,
+    kBool = 14, kFloat = 15,
+};
+
+uint64_t be(const uint8_t* p, uint32_t n) {
+    uint64_t v = 0;
+    for (uint32_t i = 0; i < n; ++i)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+// Decoder over one section (data or metadata); pointers are relative to its
+// start. Every read is bounds-checked, the file is untrusted.
+struct Section {
+    const uint8_t* d;
+    std::size_t n;
+
+    // Control byte(s) at `off`: type and size (for a pointer, size is the
+    // target offset). Leaves `off` at the payload.
+    bool ctrl(std::size_t& off, int& type, uint32_t& size) const {
+        if (off >= n)
+            return false;
+        const uint8_t c = d[off++];
+        type = c >> 5;
+        if (type == kPointer) {
+            const uint32_t ss = (c >> 3) & 3, vvv = c & 7;
+            if (off + ss + 1 > n)
+                return false;
+            const uint32_t raw = static_cast<uint32_t>(be(d + off, ss + 1));
+            off += ss + 1;
+            switch (ss) {
+            case 0: size = (vvv << 8) | raw; break;
+            case 1: size = ((vvv << 16) | raw) + 2048; break;
+            case 2: size = ((vvv << 24) | raw) + 526336; break;
+            default: size = raw; break;
+            }
+            return true;
+        }
+        if (type == 0) {
+            if (off >= n)
+                return false;
+            type = 7 + d[off++];
+        }
+        size = c & 0x1f;
+        if (size >= 29) {
+            const uint32_t extra = size - 28; // 1..3 more bytes
+            if (off + extra > n)
+                return false;
+            const uint32_t v = static_cast<uint32_t>(be(d + off, extra));
+            off += extra;
+            size = extra == 1 ? 29 + v : extra == 2 ? 285 + v : 65821 + v;
+        }
+        return true;
+    }
+
+    // ctrl(), following one pointer if there is one
+    bool value(std::size_t& off, int& type, uint32_t& size) const {
+        if (!ctrl(off, type, size))
+            return false;
+        if (type != kPointer)
+            return true;
+        off = size;
+        return ctrl(off, type, size) && type != kPointer;
+    }
+
+    // Step over the field at `off`
+    bool skip(std::size_t& off, int depth = 0) const {
+        int type;
+        uint32_t size;
+        if (depth > 32 || !ctrl(off, type, size))
+            return false;
+        switch (type) {
+        case kPointer:
+        case kBool:
+            return true;
+        case kMap:
+            for (uint64_t i = 0; i < uint64_t{size} * 2; ++i)
+                if (!skip(off, depth + 1))
+                    return false;
+            return true;
+        case kArray:
+            for (uint32_t i = 0; i < size; ++i)
+                if (!skip(off, depth + 1))
+                    return false;
+            return true;
+        default:
+            off += size;
+            return off <= n;
+        }
+    }
+
+    bool string(std::size_t off, std::string_view& out) const {
+        int type;
+        uint32_t size;
+        if (!value(off, type, size) || type != kString || off + size > n)
+            return false;
+        out = std::string_view(reinterpret_cast<const char*>(d + off), size);
+        return true;
+    }
+
+    bool number(std::size_t off, double& out) const {
+        int type;
+        uint32_t size;
+        if (!value(off, type, size) || off + size > n)
+            return false;
+        switch (type) {
+        case kDouble: {
+            if (size != 8)
+                return false;
+            const uint64_t bits = be(d + off, 8);
+            std::memcpy(&out, &bits, sizeof(out));
+            return true;
+        }
+        case kFloat: {
+            if (size != 4)
+                return false;
+            const uint32_t bits = static_cast<uint32_t>(be(d + off, 4));
+            float f;
+            std::memcpy(&f, &bits, sizeof(f));
+            out = f;
+            return true;
+        }
+        case kUint16:
+        case kUint32:
+        case kUint64:
+        case kInt32:
+            if (size > 8)
+                return false;
+            out = static_cast<double>(be(d + off, size));
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // Offset of map[k1][k2]... starting from the map at `off`
+    bool find(std::size_t off, std::initializer_list<std::string_view> path, std::size_t& out) const {
+        for (std::string_view want : path) {
+            int type;
+            uint32_t size;
+            if (!value(off, type, size) || type != kMap)
+                return false;
+            bool found = false;
+            for (uint32_t i = 0; i < size && !found; ++i) {
+                std::string_view key;
+                if (!string(off, key) || !skip(off))
+                    return false;
+                if (key == want)
+                    found = true;
+                else if (!skip(off))
+                    return false;
+            }
+            if (!found)
+                return false;
+        }
+        out = off;
+        return true;
+    }
+};
+} // namespace
+
+MmdbReader::MmdbReader(const std::string& path) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw std::runtime_error("geo db " + path + ": " + std::strerror(errno));
+    struct stat st{};
+    if (::fstat(fd, &st) != 0 || st.st_size <= 0) {
+        ::close(fd);
+        throw std::runtime_error("geo db " + path + ": empty or unreadable");
+    }
+    void* map = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+        throw std::runtime_error("geo db " + path + ": mmap: " + std::strerror(errno));
+    base_ = static_cast<const uint8_t*>(map);
+    size_ = static_cast<std::size_t>(st.st_size);
+
+    auto fail = [&](const char* why) {
+        ::munmap(const_cast<uint8_t*>(base_), size_);
+        base_ = nullptr;
+        throw std::runtime_error("geo db " + path + ": " + why);
+    };
+
+    // metadata: the map after the last marker, within the file's tail
+    if (size_ < sizeof(kMetaMarker))
+        fail("not a MaxMind DB file (no metadata)");
+    const std::size_t lo = size_ > kMetaMaxSize ? size_ - kMetaMaxSize : 0;
+    const uint8_t* meta = nullptr;
+    for (std::size_t i = size_ - sizeof(kMetaMarker) + 1; i-- > lo;)
+        if (std::memcmp(base_ + i, kMetaMarker, sizeof(kMetaMarker)) == 0) {
+            meta = base_ + i + sizeof(kMetaMarker);
+            break;
+        }
+    if (!meta)
+        fail("not a MaxMind DB file (no metadata)");
+
+    const Section ms{meta, static_cast<std::size_t>(base_ + size_ - meta)};
+    std::size_t at;
+    double v;
+    std::string_view sv;
+    auto meta_num = [&](std::string_view key, double& out) { return ms.find(0, {key}, at) && ms.number(at, out); };
+    if (!meta_num("binary_format_major_version", v) || v != 2)
+        fail("unsupported MaxMind DB format version");
+    if (!meta_num("node_count", v) || v <= 0 || v > 0xFFFFFFF0u)
+        fail("bad node_count");
+    node_count_ = static_cast<uint32_t>(v);
+    if (!meta_num("record_size", v) || (v != 24 && v != 28 && v != 32))
+        fail("unsupported record_size");
+    record_size_ = static_cast<uint32_t>(v);
+    if (!meta_num("ip_version", v) || (v != 4 && v != 6))
+        fail("bad ip_version");
+    const bool v6 = v == 6;
+    if (ms.find(0, {"database_type"}, at) && ms.string(at, sv))
+        db_type_.assign(sv);
+
+    const std::size_t tree = std::size_t{node_count_} * record_size_ * 2 / 8;
+    const std::size_t data_start = tree + 16; // 16 zero bytes separate tree and data
+    if (data_start > static_cast<std::size_t>(meta - base_) - sizeof(kMetaMarker))
+        fail("search tree larger than file");
+    data_ = base_ + data_start;
+    data_size_ = static_cast<std::size_t>(meta - base_) - sizeof(kMetaMarker) - data_start;
+
+    // IPv4 lives under ::/96 in an IPv6 tree; walk those 96 zero bits once
+    ipv4_start_ = 0;
+    if (v6)
+        for (int i = 0; i < 96 && ipv4_start_ < node_count_; ++i)
+            ipv4_start_ = record(ipv4_start_, 0);
+}
+
+MmdbReader::~MmdbReader() {
+    if (base_)
+        ::munmap(const_cast<uint8_t*>(base_), size_);
+}
+
+// Left (bit 0) or right (bit 1) record of `node`
+uint32_t MmdbReader::record(uint32_t node, int bit) const {
+    const uint8_t* p = base_ + std::size_t{node} * record_size_ * 2 / 8;
+    switch (record_size_) {
+    case 24:
+        return static_cast<uint32_t>(be(p + bit * 3, 3));
+    case 28:
+        return bit ? ((p[3] & 0x0Fu) << 24) | static_cast<uint32_t>(be(p + 4, 3))
+                   : ((p[3] & 0xF0u) << 20) | static_cast<uint32_t>(be(p, 3));
+    default:
+        return static_cast<uint32_t>(be(p + bit * 4, 4));
+    }
+}
+
+bool MmdbReader::lookup(uint32_t ip, Record& out) const {
+    out = Record{};
+    uint32_t node = ipv4_start_;
+    for (int bit = 31; bit >= 0 && node < node_count_; --bit)
+        node = record(node, (ip >> bit) & 1);
+    if (node <= node_count_) // == node_count: no data for this network
+        return false;
+    const std::size_t off = std::size_t{node} - node_count_ - 16;
+    if (off >= data_size_)
+        return false;
+
+    // one pass over the record's top-level map; only the keys we use are
+    // descended into, everything else is skipped in place
+    const Section ds{data_, data_size_};
+    std::size_t p = off, at;
+    int type;
+    uint32_t size;
+    if (!ds.value(p, type, size) || type != kMap)
+        return true;
+    std::string_view reg_country, reg_iso;
+    for (uint32_t i = 0; i < size; ++i) {
+        std::string_view key;
+        if (!ds.string(p, key) || !ds.skip(p))
+            break;
+        if (key == "city") {
+            if (ds.find(p, {"names", "en"}, at))
+                ds.string(at, out.city);
+        } else if (key == "country" || key == "registered_country") {
+            std::string_view& name = key == "country" ? out.country : reg_country;
+            std::string_view& iso = key == "country" ? out.country_iso : reg_iso;
+            if (ds.find(p, {"names", "en"}, at))
+                ds.string(at, name);
+            if (ds.find(p, {"iso_code"}, at))
+                ds.string(at, iso);
+        } else if (key == "location") {
+            out.has_location = ds.find(p, {"latitude"}, at) && ds.number(at, out.lat) &&
+                               ds.find(p, {"longitude"}, at) && ds.number(at, out.lon);
+        } else if (key == "autonomous_system_number") {
+            double asn;
+            if (ds.number(p, asn))
+                out.asn = static_cast<uint32_t>(asn);
+        } else if (key == "autonomous_system_organization") {
+            ds.string(p, out.as_org);
+        }
+        if (!ds.skip(p))
+            break;
+    }
+    if (out.country.empty()) {
+        out.country = reg_country;
+        out.country_iso = reg_iso;
+    }
+    return true;
+}
+
+} // namespace geo
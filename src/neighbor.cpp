@@ -0,0 +1,165 @@
+// ===================== File: src/neighbor.cpp =====================
+#include "neighbor.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <ifaddrs.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <net/route.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace geo {
+
+namespace {
+
+std::string iface_for(const in_addr& src) {
+    ifaddrs* ifs = nullptr;
+    if (::getifaddrs(&ifs) < 0)
+        throw std::runtime_error("getifaddrs failed");
+    std::string name;
+    for (ifaddrs* i = ifs; i; i = i->ifa_next) {
+        if (!i->ifa_addr || i->ifa_addr->sa_family != AF_INET)
+            continue;
+        if (reinterpret_cast<sockaddr_in*>(i->ifa_addr)->sin_addr.s_addr == src.s_addr) {
+            name = i->ifa_name;
+            break;
+        }
+    }
+    ::freeifaddrs(ifs);
+    if (name.empty())
+        throw std::runtime_error("no interface owns the source address");
+    return name;
+}
+
+// /proc/net/route prints addresses as the raw __be32, so they compare
+// directly against s_addr.
+in_addr next_hop_for(const std::string& ifname, const in_addr& dst) {
+    std::ifstream in("/proc/net/route");
+    if (!in)
+        throw std::runtime_error("can't read /proc/net/route");
+    std::string line;
+    std::getline(in, line); // header
+
+    int best_len = -1;
+    unsigned best_metric = 0;
+    uint32_t best_gw = 0;
+    while (std::getline(in, line)) {
+        std::istringstream ss(line);
+        std::string dev, dest_s, gw_s, mask_s;
+        unsigned flags = 0, refcnt = 0, use = 0, metric = 0;
+        if (!(ss >> dev >> dest_s >> gw_s >> std::hex >> flags >> std::dec >> refcnt >> use >> metric >> mask_s))
+            continue;
+        if (dev != ifname || !(flags & RTF_UP))
+            continue;
+        uint32_t dest = static_cast<uint32_t>(std::strtoul(dest_s.c_str(), nullptr, 16));
+        uint32_t gw = static_cast<uint32_t>(std::strtoul(gw_s.c_str(), nullptr, 16));
+        uint32_t mask = static_cast<uint32_t>(std::strtoul(mask_s.c_str(), nullptr, 16));
+        if ((dst.s_addr & mask) != dest)
+            continue;
+        int len = __builtin_popcount(mask);
+        if (len > best_len || (len == best_len && metric < best_metric)) {
+            best_len = len;
+            best_metric = metric;
+            best_gw = (flags & RTF_GATEWAY) ? gw : 0;
+        }
+    }
+    if (best_len < 0)
+        throw std::runtime_error("no route to destination via " + ifname);
+    in_addr hop{};
+    hop.s_addr = best_gw ? best_gw : dst.s_addr;
+    return hop;
+}
+
+bool arp_lookup(const std::string& ifname, const in_addr& ip, std::array<uint8_t, 6>& mac) {
+    std::ifstream in("/proc/net/arp");
+    std::string line;
+    std::getline(in, line); // header
+    char want[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &ip, want, sizeof(want));
+    while (std::getline(in, line)) {
+        std::istringstream ss(line);
+        std::string addr, hwtype, flags_s, hw, mask, dev;
+        if (!(ss >> addr >> hwtype >> flags_s >> hw >> mask >> dev))
+            continue;
+        unsigned flags = static_cast<unsigned>(std::strtoul(flags_s.c_str(), nullptr, 16));
+        if (addr != want || dev != ifname || !(flags & ATF_COM))
+            continue;
+        unsigned b[6];
+        if (std::sscanf(hw.c_str(), "%x:%x:%x:%x:%x:%x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]) != 6)
+            return false;
+        for (int i = 0; i < 6; ++i)
+            mac[i] = static_cast<uint8_t>(b[i]);
+        return true;
+    }
+    return false;
+}
+
+// Any datagram towards the neighbor makes the kernel ARP for it.
+void poke_neighbor(const in_addr& ip) {
+    int s = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (s < 0)
+        return;
+    sockaddr_in to{};
+    to.sin_family = AF_INET;
+    to.sin_port = htons(9); // discard
+    to.sin_addr = ip;
+    (void)::sendto(s, "", 0, 0, reinterpret_cast<sockaddr*>(&to), sizeof(to));
+    ::close(s);
+}
+
+} // namespace
+
+std::array<uint8_t, 14> LinkInfo::eth_header() const {
+    std::array<uint8_t, 14> h{};
+    std::memcpy(h.data(), dst_mac.data(), 6);
+    std::memcpy(h.data() + 6, src_mac.data(), 6);
+    h[12] = ETHERTYPE_IP >> 8;
+    h[13] = ETHERTYPE_IP & 0xFF;
+    return h;
+}
+
+LinkInfo resolve_link(const in_addr& dst, const in_addr& src) {
+    LinkInfo li;
+    li.ifname = iface_for(src);
+    li.ifindex = static_cast<int>(::if_nametoindex(li.ifname.c_str()));
+    if (li.ifindex == 0)
+        throw std::runtime_error("if_nametoindex(" + li.ifname + ") failed");
+
+    int s = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (s < 0)
+        throw std::runtime_error("socket(AF_INET,SOCK_DGRAM) failed");
+    ifreq ifr{};
+    std::strncpy(ifr.ifr_name, li.ifname.c_str(), IFNAMSIZ - 1);
+    int rc = ::ioctl(s, SIOCGIFHWADDR, &ifr);
+    ::close(s);
+    if (rc < 0)
+        throw std::runtime_error("SIOCGIFHWADDR(" + li.ifname + ") failed");
+
+    // frames injected on lo carry no route and get dropped as martians
+    if (ifr.ifr_hwaddr.sa_family == ARPHRD_LOOPBACK)
+        throw std::runtime_error("destination is local (loopback), packet mode can't reach it");
+    if (ifr.ifr_hwaddr.sa_family != ARPHRD_ETHER)
+        throw std::runtime_error(li.ifname + " is not an Ethernet interface");
+    std::memcpy(li.src_mac.data(), ifr.ifr_hwaddr.sa_data, 6);
+
+    li.next_hop = next_hop_for(li.ifname, dst);
+    for (int attempt = 0; !arp_lookup(li.ifname, li.next_hop, li.dst_mac); ++attempt) {
+        if (attempt == 10)
+            throw std::runtime_error("no ARP entry for next hop on " + li.ifname);
+        poke_neighbor(li.next_hop);
+        ::usleep(100 * 1000);
+    }
+    return li;
+}
+
+} // namespace geo
@@ -0,0 +1,197 @@
+// ===================== File: src/packet_ring.cpp =====================
+#include "packet_ring.hpp"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <net/ethernet.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace geo {
+
+namespace {
+constexpr unsigned kBlockSize = 1u << 18; // 256 KiB
+constexpr unsigned kBlockNr = 32;         // 8 MiB ring
+constexpr unsigned kFrameSize = 2048;
+constexpr unsigned kBlockTimeoutMs = 1;
+
+constexpr unsigned kTxFrameSize = 2048;
+constexpr unsigned kTxFrameNr = 256;
+} // namespace
+
+PacketRing::~PacketRing() { close(); }
+
+bool PacketRing::open(const std::vector<sock_filter>& filter) {
+    if (fd_ != -1)
+        return true;
+
+    // cooked (SOCK_DGRAM) so data starts at the IP header like the raw sockets
+    fd_ = ::socket(AF_PACKET, SOCK_DGRAM, htons(ETH_P_IP));
+    if (fd_ < 0)
+        return false;
+
+    // filter before the ring exists, so nothing unfiltered gets queued
+    sock_fprog fp{};
+    fp.len = static_cast<unsigned short>(filter.size());
+    fp.filter = const_cast<sock_filter*>(filter.data());
+    int ver = TPACKET_V3;
+    tpacket_req3 req{};
+    req.tp_block_size = kBlockSize;
+    req.tp_block_nr = kBlockNr;
+    req.tp_frame_size = kFrameSize;
+    req.tp_frame_nr = (kBlockSize / kFrameSize) * kBlockNr;
+    req.tp_retire_blk_tov = kBlockTimeoutMs;
+    if (::setsockopt(fd_, SOL_SOCKET, SO_ATTACH_FILTER, &fp, sizeof(fp)) < 0 ||
+        ::setsockopt(fd_, SOL_PACKET, PACKET_VERSION, &ver, sizeof(ver)) < 0 ||
+        ::setsockopt(fd_, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+        close();
+        return false;
+    }
+
+    map_len_ = static_cast<std::size_t>(kBlockSize) * kBlockNr;
+    void* m = ::mmap(nullptr, map_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, fd_, 0);
+    if (m == MAP_FAILED) // MAP_LOCKED needs RLIMIT_MEMLOCK headroom; fine without
+        m = ::mmap(nullptr, map_len_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (m == MAP_FAILED) {
+        map_len_ = 0;
+        close();
+        return false;
+    }
+    map_ = static_cast<uint8_t*>(m);
+    block_size_ = kBlockSize;
+    block_nr_ = kBlockNr;
+    cur_ = 0;
+
+    // every interface: replies may come back on a different one
+    sockaddr_ll ll{};
+    ll.sll_family = AF_PACKET;
+    ll.sll_protocol = htons(ETH_P_IP);
+    ll.sll_ifindex = 0;
+    if (::bind(fd_, reinterpret_cast<sockaddr*>(&ll), sizeof(ll)) < 0) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void PacketRing::close() {
+    if (map_) {
+        ::munmap(map_, map_len_);
+        map_ = nullptr;
+        map_len_ = 0;
+    }
+    if (fd_ != -1) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+tpacket_block_desc* PacketRing::ready_block() const {
+    auto* bd = reinterpret_cast<tpacket_block_desc*>(map_ + static_cast<std::size_t>(cur_) * block_size_);
+    if (!(__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER))
+        return nullptr;
+    return bd;
+}
+
+void PacketRing::release_block() {
+    auto* bd = reinterpret_cast<tpacket_block_desc*>(map_ + static_cast<std::size_t>(cur_) * block_size_);
+    __atomic_store_n(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+    cur_ = (cur_ + 1) % block_nr_;
+}
+
+// ------------------------------------------
+// PacketTxRing
+// ------------------------------------------
+PacketTxRing::~PacketTxRing() { close(); }
+
+bool PacketTxRing::open(int ifindex) {
+    if (fd_ != -1)
+        return true;
+
+    // protocol 0: transmit only, nothing gets queued for reading
+    fd_ = ::socket(AF_PACKET, SOCK_RAW, 0);
+    if (fd_ < 0)
+        return false;
+
+    int ver = TPACKET_V2;
+    tpacket_req req{};
+    req.tp_block_size = kTxFrameSize * 16;
+    req.tp_block_nr = kTxFrameNr / 16;
+    req.tp_frame_size = kTxFrameSize;
+    req.tp_frame_nr = kTxFrameNr;
+    int one = 1;
+    if (::setsockopt(fd_, SOL_PACKET, PACKET_VERSION, &ver, sizeof(ver)) < 0 ||
+        ::setsockopt(fd_, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) < 0) {
+        close();
+        return false;
+    }
+    // probes don't need traffic shaping; not fatal on old kernels
+    (void)::setsockopt(fd_, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(one));
+
+    map_len_ = static_cast<std::size_t>(kTxFrameSize) * kTxFrameNr;
+    void* m = ::mmap(nullptr, map_len_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (m == MAP_FAILED) {
+        map_len_ = 0;
+        close();
+        return false;
+    }
+    map_ = static_cast<uint8_t*>(m);
+    frame_nr_ = kTxFrameNr;
+    cur_ = 0;
+
+    sockaddr_ll ll{};
+    ll.sll_family = AF_PACKET;
+    ll.sll_protocol = htons(ETH_P_IP);
+    ll.sll_ifindex = ifindex;
+    if (::bind(fd_, reinterpret_cast<sockaddr*>(&ll), sizeof(ll)) < 0) {
+        close();
+        return false;
+    }
+    ifindex_ = ifindex;
+    return true;
+}
+
+void PacketTxRing::close() {
+    if (map_) {
+        ::munmap(map_, map_len_);
+        map_ = nullptr;
+        map_len_ = 0;
+    }
+    if (fd_ != -1) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+bool PacketTxRing::push(const uint8_t* l2, std::size_t l2_len, const uint8_t* pkt, std::size_t len) {
+    constexpr std::size_t kData = TPACKET2_HDRLEN - sizeof(sockaddr_ll);
+    if (kData + l2_len + len > kTxFrameSize)
+        return false;
+
+    auto* h = reinterpret_cast<tpacket2_hdr*>(map_ + static_cast<std::size_t>(cur_) * kTxFrameSize);
+    const auto status = __atomic_load_n(&h->tp_status, __ATOMIC_ACQUIRE);
+    if (status != TP_STATUS_AVAILABLE && status != TP_STATUS_WRONG_FORMAT)
+        return false;
+
+    uint8_t* data = reinterpret_cast<uint8_t*>(h) + kData;
+    std::memcpy(data, l2, l2_len);
+    std::memcpy(data + l2_len, pkt, len);
+    h->tp_len = static_cast<uint32_t>(l2_len + len);
+    __atomic_store_n(&h->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+    cur_ = (cur_ + 1) % frame_nr_;
+    return true;
+}
+
+int PacketTxRing::kick() {
+    // blocking send: returns once the queued frames have left the ring
+    for (;;) {
+        if (::send(fd_, nullptr, 0, 0) >= 0)
+            return 0;
+        if (errno != EINTR)
+            return -errno;
+    }
+}
+
+} // namespace geo
@@ -0,0 +1,83 @@
+// ===================== File: src/recv_ring.cpp =====================
+#include "recv_ring.hpp"
+
+#include <cerrno>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+
+namespace geo {
+
+bool enable_rx_timestamps(int fd) {
+    int on = 1;
+    return ::setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) == 0;
+}
+
+bool enable_tx_timestamps(int fd) {
+    // no OPT_TSONLY: the looped-back packet is how we tell probes apart
+    int flags = SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    return ::setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == 0;
+}
+
+RecvRing::RecvRing()
+    : buf_(static_cast<std::size_t>(kSlots) * kSlotSize),
+      ctl_(static_cast<std::size_t>(kSlots) * kCtlSize),
+      from_(kSlots), iov_(kSlots), msgs_(kSlots) {
+    for (int i = 0; i < kSlots; ++i) {
+        iov_[i].iov_base = &buf_[static_cast<std::size_t>(i) * kSlotSize];
+        iov_[i].iov_len = kSlotSize;
+        msgs_[i].msg_hdr.msg_iov = &iov_[i];
+        msgs_[i].msg_hdr.msg_iovlen = 1;
+        msgs_[i].msg_hdr.msg_name = &from_[i];
+        msgs_[i].msg_hdr.msg_control = &ctl_[static_cast<std::size_t>(i) * kCtlSize];
+    }
+}
+
+int RecvRing::drain(int fd, int flags) {
+    // the kernel overwrites these on every call
+    for (int i = 0; i < kSlots; ++i) {
+        msgs_[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+        msgs_[i].msg_hdr.msg_controllen = kCtlSize;
+    }
+
+    int n;
+    do
+        n = ::recvmmsg(fd, msgs_.data(), kSlots, MSG_DONTWAIT | flags, nullptr);
+    while (n < 0 && errno == EINTR);
+    at_ = std::chrono::steady_clock::now();
+    sys_at_ = std::chrono::system_clock::now();
+    return n < 0 ? 0 : n;
+}
+
+// SCM_TIMESTAMPNS on receive, SCM_TIMESTAMPING (software slot) on the error queue
+const timespec* RecvRing::stamp(int i) const {
+    msghdr& mh = const_cast<msghdr&>(msgs_[i].msg_hdr);
+    for (cmsghdr* c = CMSG_FIRSTHDR(&mh); c; c = CMSG_NXTHDR(&mh, c)) {
+        if (c->cmsg_level != SOL_SOCKET)
+            continue;
+        if (c->cmsg_type == SCM_TIMESTAMPNS)
+            return reinterpret_cast<const timespec*>(CMSG_DATA(c));
+        if (c->cmsg_type == SCM_TIMESTAMPING) {
+            auto* ts = reinterpret_cast<const scm_timestamping*>(CMSG_DATA(c));
+            if (ts->ts[0].tv_sec || ts->ts[0].tv_nsec)
+                return &ts->ts[0];
+        }
+    }
+    return nullptr;
+}
+
+bool RecvRing::kernel_stamped(int i) const {
+    return stamp(i) != nullptr;
+}
+
+std::chrono::steady_clock::time_point RecvRing::received_at(int i) const {
+    using namespace std::chrono;
+    const timespec* ts = stamp(i);
+    if (!ts)
+        return at_;
+    // kernel stamps are CLOCK_REALTIME; shift by how long ago they were taken
+    const system_clock::time_point k{duration_cast<system_clock::duration>(
+        seconds(ts->tv_sec) + nanoseconds(ts->tv_nsec))};
+    return at_ - duration_cast<steady_clock::duration>(sys_at_ - k);
+}
+
+} // namespace geo
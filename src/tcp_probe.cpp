@@ -9,21 +9,29 @@
 #include "utils_net.hpp"
 #include "net_compat.hpp"
 #include "tcp_probe_common.hpp"
+#include "event_loop.hpp"
+#include "recv_ring.hpp"
+#include "bpf_filter.hpp"
+#include "packet_ring.hpp"
+#include "neighbor.hpp"
 
 
 #include <algorithm>
 #include <array>
 #include <chrono>
+#include <cstdio>
 #include <cstring>
 #include <fcntl.h>
+#include <initializer_list>
+#include <memory>
 #include <optional>
 #include <stdexcept>
-#include <unordered_map>
 #include <vector>
 
 #include <arpa/inet.h>
+#include <net/ethernet.h>
 #include <netinet/tcp.h>
-#include <sys/select.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -31,56 +39,259 @@
 namespace geo
 {
 // forward declarations (now in other cpp files)
-std::vector<uint16_t> send_raw_probes(
-    int raw_send_sock, const sockaddr_in &dst,
-    const in_addr &src_ip, const in_addr &dst_ip,
-    int port, int ttl, DiagLogger *diag,
-    std::unordered_map<uint16_t, ProbeState> &in_flight);
+void send_raw_probes(
+    RawSynBatch &tx, const sockaddr_in &dst, SynTemplate &syn,
+    int ttl, const uint16_t *sports, int nports, uint32_t target,
+    ProbeTable &probes);
 
-std::unordered_map<uint16_t,int> send_connect_probes(
-    const sockaddr_in &dst, const in_addr &src_ip, int ttl, DiagLogger *diag,
-    std::unordered_map<uint16_t, ProbeState> &in_flight);
+void flush_raw_probes(int raw_send_sock, const std::vector<TxLink> *links,
+                      RawSynBatch &tx, ProbeTable &probes, DiagLogger *diag);
 
-// ===================================================================
-// TcpProbe::trace
-// Main driver. Sends 3 probes per TTL until dest reached or max_hops.
-// ===================================================================
-std::vector<ProbeHopSummary>
-TcpProbe::trace(const std::string &host, int port, int max_hops, int timeout_ms,
-                SendMode mode, DiagLogger *diag)
+void send_connect_probes(
+    const sockaddr_in &dst, const in_addr &src_ip, int ttl,
+    const uint16_t *sports, int nports, uint32_t target, DiagLogger *diag,
+    ProbeTable &probes);
+
+namespace
+{
+constexpr int kProbesPerHop = 3;
+// 33434 + ttl*3 used to be the port formula; a single trace still gets
+// exactly those ports because the pool hands them out in order.
+constexpr uint16_t kFirstPort = 33437;
+constexpr int kPortRange = 16384;
+
+// HopSlot: one TTL's probes while they are in flight
+struct HopSlot
+{
+    HopAgg agg;
+    std::array<uint16_t, kProbesPerHop> sports{}; // sockets live in the ProbeTable
+    int nports = 0;
+    int resolved = 0; // probes answered or timed out
+    bool closed = false;
+};
+
+// TargetRun: everything one destination needs while it is being traced
+struct TargetRun
+{
+    std::size_t index = 0;
+    std::string tag; // diag prefix, empty for a single trace
+    in_addr dst_ip{};
+    in_addr src_ip{};
+    sockaddr_in dst{};
+    int port = 0;
+    LinkInfo link;             // SendMode::Packet only
+    SynTemplate syn;           // crafted modes: this target's SYN, stamped per probe
+    std::vector<HopSlot> hops; // indexed by ttl, allocated while active
+    int stop_ttl = 0;          // lowest ttl that got a reply from the destination
+    int next_ttl = 1;          // next ttl to send
+    int reported = 0;          // hops handed to opt.on_hop so far
+    int open_hops = 0;
+    bool reached = false;
+    bool finished = false;
+};
+
+// PortPool: hands out source ports round-robin so a port isn't reused until
+// the rest of the range went by (late replies then stay unmatched).
+class PortPool
+{
+public:
+    PortPool() : used_(kPortRange, 0) {}
+
+    uint16_t take()
+    {
+        for (int n = 0; n < kPortRange; ++n)
+        {
+            int i = cursor_;
+            cursor_ = (cursor_ + 1) % kPortRange;
+            if (!used_[i])
+            {
+                used_[i] = 1;
+                return static_cast<uint16_t>(kFirstPort + i);
+            }
+        }
+        return 0;
+    }
+
+    void give(uint16_t port)
+    {
+        int i = port - kFirstPort;
+        if (i >= 0 && i < kPortRange)
+            used_[i] = 0;
+    }
+
+private:
+    std::vector<uint8_t> used_;
+    int cursor_ = 0;
+};
+
+ProbeHopSummary hop_row(const HopAgg &agg, int ttl)
+{
+    ProbeHopSummary row{};
+    row.ttl = ttl;
+    row.reached = agg.reached;
+    row.num_replies = agg.count;
+    if (agg.count > 0)
+    {
+        row.hop_ip = ip_to_string(agg.addr);
+        row.hop_addr = agg.addr;
+        row.rtt_min_ms = agg.min_ms;
+        row.rtt_max_ms = agg.max_ms;
+        row.rtt_avg_ms = agg.sum_ms / agg.count;
+    }
+    return row;
+}
+
+void add_sample(HopAgg &agg, uint32_t addr, double rtt)
 {
-    // --- resolve destination
-    auto addrs = DNSResolver::resolve(host, port);
-    in_addr dst_ip = pick_ipv4(addrs);
-    in_addr src_ip = find_local_ipv4_to(dst_ip);
+    if (agg.count == 0)
+        agg.addr = addr;
+    agg.count++;
+    if (agg.count == 1)
+        agg.min_ms = agg.max_ms = rtt;
+    else
+    {
+        agg.min_ms = std::min(agg.min_ms, rtt);
+        agg.max_ms = std::max(agg.max_ms, rtt);
+    }
+    agg.sum_ms += rtt;
+}
 
-    if (diag)
+// one table per thread, reused by every trace()/trace_many() on it
+ProbeTable &probe_table()
+{
+    thread_local ProbeTable table;
+    return table;
+}
+
+const char *mode_name(SendMode mode)
+{
+    switch (mode)
     {
-        char dbuf[INET_ADDRSTRLEN], sbuf[INET_ADDRSTRLEN];
-        inet_ntop(AF_INET, &dst_ip, dbuf, sizeof(dbuf));
-        inet_ntop(AF_INET, &src_ip, sbuf, sizeof(sbuf));
-        diag->log(std::string("SETUP src=") + sbuf + " dst=" + dbuf + ":" + std::to_string(port) +
-                  " mode=" + (mode == SendMode::Raw ? "raw" :
-                              mode == SendMode::Connect ? "connect" : "auto"));
+    case SendMode::Raw:
+        return "raw";
+    case SendMode::Packet:
+        return "packet";
+    case SendMode::Connect:
+        return "connect";
+    default:
+        return "auto";
     }
+}
+
+// ===================================================================
+// TraceEngine
+// Shared ICMP / TCP-sniff / raw-send sockets + one reactor for a whole
+// batch of targets. Targets are started in order as the in-flight budget
+// allows and handed back through the callback as soon as they finish.
+// ===================================================================
+class TraceEngine
+{
+public:
+    TraceEngine(const TraceOptions &opt, const TraceCallback &on_done);
+    ~TraceEngine();
+
+    void run(std::vector<TargetRun> &runs);
+
+private:
+    void open_reply_sockets();
+    void open_send_socket();
+    void open_receivers(const std::vector<TargetRun> &runs);
+    void open_tx_rings(const std::vector<TargetRun> &runs);
+    bool can_send(clk::time_point now) const;
+    bool top_up(TargetRun &t);
+    void flush_tx();
+    void start(TargetRun &t);
+    void retire(TargetRun &t, int ttl);
+    void report_hops(TargetRun &t);
+    void resolve(ProbeState &ps);
+    void finish(TargetRun &t);
+    void on_icmp();
+    void on_time_exceeded(const IcmpListener::TimeExceeded &te);
+    void on_ring();
+    void on_tcp();
+    void on_tcp_segment(const uint8_t *buf, std::size_t n, clk::time_point at);
+    void on_connect_done(uint16_t sport);
+    void read_tx_stamps();
+    void on_tx_stamp(const uint8_t *pkt, std::size_t n, clk::time_point at);
+    void log(const TargetRun &t, const std::string &line) const;
+
+    TraceOptions opt_;
+    const TraceCallback &on_done_;
+    int window_ = 1;
+    int budget_ = 0;
+
+    IcmpListener icmp_;
+    int tcp_recv_sock_ = -1;
+    RecvRing tcp_rx_;
+    PacketRing rx_ring_; // opt.rx_ring: replaces icmp_ + tcp_recv_sock_
+    int raw_send_sock_ = -1;
+    RecvRing tx_stamps_;   // raw_send_sock_ error queue: SYNs looped back with TX stamps
+    int tx_unstamped_ = 0; // sent since the error queue was last read (0 = nothing to wait for)
+    RawSynBatch tx_; // raw SYNs waiting for the next sendmmsg() / ring kick
+    bool crafted_ = false; // Raw or Packet: we build the SYNs ourselves
+    std::vector<std::unique_ptr<PacketTxRing>> tx_rings_; // Packet: one per interface
+    std::vector<TxLink> tx_links_;                        // Packet: per target
+
+    EventLoop loop_;
+    std::vector<uint64_t> expired_;
+    ProbeTable &probes_; // key: source port
+    PortPool ports_;
+    std::vector<TargetRun> *runs_ = nullptr;
+    std::vector<TargetRun *> active_;
+
+    clk::duration pace_step_{};
+    clk::time_point pace_next_{};
+};
+
+TraceEngine::TraceEngine(const TraceOptions &opt, const TraceCallback &on_done)
+    : opt_(opt), on_done_(on_done), probes_(probe_table())
+{
+    crafted_ = opt_.mode == SendMode::Raw || opt_.mode == SendMode::Packet;
+    window_ = (opt_.ttl_window <= 0 || opt_.ttl_window > opt_.max_hops) ? opt_.max_hops : opt_.ttl_window;
+    budget_ = std::clamp(opt_.max_in_flight, kProbesPerHop, kPortRange);
+    if (opt_.probes_per_sec > 0)
+        pace_step_ = std::chrono::duration_cast<clk::duration>(
+            std::chrono::duration<double>(double(kProbesPerHop) / opt_.probes_per_sec));
+    // connect probes' sockets are watched by port, one handler for all
+    if (!crafted_)
+        loop_.set_tag_handler([this](uint64_t sport, uint32_t) { on_connect_done(static_cast<uint16_t>(sport)); });
+    // the ring needs the destination set for its filter, see open_receivers()
+    if (!opt_.rx_ring)
+        open_reply_sockets();
+    open_send_socket();
+}
 
+TraceEngine::~TraceEngine()
+{
+    // --- cleanup everything (the table is only non-empty if run() threw)
+    probes_.clear();
+    if (raw_send_sock_ >= 0)
+        ::close(raw_send_sock_);
+    if (tcp_recv_sock_ >= 0)
+        ::close(tcp_recv_sock_);
+    icmp_.close();
+    rx_ring_.close();
+}
+
+void TraceEngine::open_reply_sockets()
+{
     // --- ICMP receiver
-    IcmpListener icmp;
     bool ok = false;
-    switch (mode)
+    switch (opt_.mode)
     {
     case SendMode::Raw:
-        ok = icmp.open(IcmpListener::OpenMode::RawOnly);
+    case SendMode::Packet:
+        ok = icmp_.open(IcmpListener::OpenMode::RawOnly);
         break;
 
     // I HATE THE STUPID NIC ISSUE FFS I BOUGHT A ACTUAL NIC TO DEBUG THIS CRAP,
     // spent 50 bucks to get the NIC to not use this route. still stuck here.
     case SendMode::Connect:
-        ok = icmp.open(IcmpListener::OpenMode::DatagramOnly);
+        ok = icmp_.open(IcmpListener::OpenMode::DatagramOnly);
         break;
 
     case SendMode::Auto:
-        ok = icmp.open(IcmpListener::OpenMode::Auto);
+        ok = icmp_.open(IcmpListener::OpenMode::Auto);
         break;
     }
 
@@ -89,223 +300,307 @@ TcpProbe::trace(const std::string &host, int port, int max_hops, int timeout_ms,
         throw std::runtime_error("Failed to open ICMP socket (need CAP_NET_RAW/root)");
 
     // --- TCP raw recv socket (for RST/SYNACK)
-    int tcp_recv_sock = ::socket(AF_INET, SOCK_RAW, IPPROTO_TCP);
-    if (tcp_recv_sock < 0)
+    tcp_recv_sock_ = ::socket(AF_INET, SOCK_RAW, IPPROTO_TCP);
+    if (tcp_recv_sock_ < 0)
         throw std::runtime_error("Need CAP_NET_RAW/root to sniff TCP");
+    // RTTs end at the kernel's RX stamp, not when the loop got around to us
+    if (!enable_rx_timestamps(tcp_recv_sock_) && opt_.diag)
+        opt_.diag->log(std::string("WARN RX timestamps on TCP sniff socket failed: ") + std::strerror(errno));
 
-    int raw_send_sock = -1;
+    loop_.watch(icmp_.fd(), EPOLLIN, [this](uint32_t) { on_icmp(); });
+    loop_.watch(tcp_recv_sock_, EPOLLIN, [this](uint32_t) { on_tcp(); });
+}
 
+void TraceEngine::open_send_socket()
+{
     // this should be default but NAT ate my ICMP logs.
-    if (mode == SendMode::Raw)
+    if (opt_.mode == SendMode::Raw)
     {
-        raw_send_sock = ::socket(AF_INET, SOCK_RAW, IPPROTO_TCP);
-        if (raw_send_sock < 0)
+        raw_send_sock_ = ::socket(AF_INET, SOCK_RAW, IPPROTO_TCP);
+        if (raw_send_sock_ < 0)
             throw std::runtime_error("raw send socket failed");
         int on = 1;
-        (void)setsockopt(raw_send_sock, IPPROTO_IP, IP_HDRINCL, &on, sizeof(on));
+        (void)setsockopt(raw_send_sock_, IPPROTO_IP, IP_HDRINCL, &on, sizeof(on));
+
+        // ...and start at the driver's TX stamp instead of the sendmmsg() call.
+        // Stamps land on the error queue, which epoll reports as EPOLLERR.
+        if (enable_tx_timestamps(raw_send_sock_))
+            loop_.watch(raw_send_sock_, 0, [this](uint32_t) { read_tx_stamps(); });
+        else if (opt_.diag)
+            opt_.diag->log(std::string("WARN TX timestamps on raw send socket failed: ") + std::strerror(errno));
     }
+}
 
-    // ----------------------------------------------------
-    // main probing sequence
-    // ----------------------------------------------------
-    std::vector<ProbeHopSummary> out;
-    sockaddr_in dst{};
-    dst.sin_family = AF_INET;
-    dst.sin_port = htons(port);
-    dst.sin_addr = dst_ip;
-
-    std::unordered_map<uint16_t, ProbeState> in_flight; // key: source port
-    bool destination_reached = false;
+// Only let the kernel queue replies that can match a probe of this batch:
+// SYN-ACK/RST from a target to a pool port, Time Exceeded quoting one.
+void TraceEngine::open_receivers(const std::vector<TargetRun> &runs)
+{
+    std::vector<uint32_t> dsts;
+    for (const auto &t : runs)
+        if (!t.finished)
+            dsts.push_back(t.dst_ip.s_addr);
+    const bpf::PortRange ports{kFirstPort, static_cast<uint16_t>(kFirstPort + kPortRange - 1)};
 
-    for (int ttl = 1; ttl <= max_hops && !destination_reached; ++ttl)
+    if (opt_.rx_ring)
     {
-        in_flight.clear();
-        HopAgg agg{};
-        if (diag)
-            diag->log("HOP " + std::to_string(ttl) + ": send 3 probes");
-
-        // ----------------------------------------------------
-        // send probes (refactored out of this god-function)
-        // ----------------------------------------------------
-        std::unordered_map<uint16_t,int> probe_socks;
-        if (mode == SendMode::Raw)
-            send_raw_probes(raw_send_sock, dst, src_ip, dst_ip, port, ttl, diag, in_flight);
-        else
-            probe_socks = send_connect_probes(dst, src_ip, ttl, diag, in_flight);
+        if (rx_ring_.open(bpf::reply_filter(dsts, ports)))
+        {
+            loop_.watch(rx_ring_.fd(), EPOLLIN, [this](uint32_t) { on_ring(); });
+            return;
+        }
+        if (opt_.diag)
+            opt_.diag->log(std::string("WARN rx ring unavailable, using sockets: ") + std::strerror(errno));
+        open_reply_sockets();
+    }
 
-        // ----------------------------------------------------
-        // wait for replies (ICMP TimeExceeded or TCP replies)
-        // ----------------------------------------------------
-        using clk = std::chrono::steady_clock;
-        auto deadline = clk::now() + std::chrono::milliseconds(timeout_ms);
-        int replies_seen = 0;
+    if (!bpf::attach(tcp_recv_sock_, bpf::tcp_reply_filter(dsts, ports)) && opt_.diag)
+        opt_.diag->log(std::string("WARN BPF filter on TCP sniff socket failed: ") + std::strerror(errno));
+    // datagram ICMP sockets only see our own errors, no filter needed
+    if (icmp_.is_raw() &&
+        !bpf::attach(icmp_.fd(), bpf::icmp_time_exceeded_filter(dsts, ports)) && opt_.diag)
+        opt_.diag->log(std::string("WARN BPF filter on ICMP socket failed: ") + std::strerror(errno));
+}
 
-        // --- hot loop; should be event-driven but life’s too short
-        while (clk::now() < deadline && replies_seen < 3)
+// SendMode::Packet: one TX ring per egress interface, shared by its targets
+void TraceEngine::open_tx_rings(const std::vector<TargetRun> &runs)
+{
+    tx_links_.resize(runs.size());
+    for (const auto &t : runs)
+    {
+        if (t.finished)
+            continue;
+        PacketTxRing *ring = nullptr;
+        for (auto &r : tx_rings_)
+            if (r->ifindex() == t.link.ifindex)
+                ring = r.get();
+        if (!ring)
         {
-            fd_set rfds;
-            FD_ZERO(&rfds);
-            int maxfd = -1;
-            FD_SET(icmp.fd(), &rfds);
-            maxfd = std::max(maxfd, icmp.fd());
-            FD_SET(tcp_recv_sock, &rfds);
-            maxfd = std::max(maxfd, tcp_recv_sock);
-
-            auto now = clk::now();
-            auto remain = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now);
-            if (remain.count() < 0)
-                break;
-            timeval tv{static_cast<long>(remain.count() / 1000),
-                       static_cast<suseconds_t>((remain.count() % 1000) * 1000)};
+            auto r = std::make_unique<PacketTxRing>();
+            if (!r->open(t.link.ifindex))
+                throw std::runtime_error("PACKET_TX_RING on " + t.link.ifname + " failed: " + std::strerror(errno));
+            ring = r.get();
+            tx_rings_.push_back(std::move(r));
+        }
+        tx_links_[t.index] = TxLink{ring, t.link.eth_header()};
+    }
+}
 
-            int rc = ::select(maxfd + 1, &rfds, nullptr, nullptr, &tv);
-            if (rc <= 0)
-                continue;
+void TraceEngine::log(const TargetRun &t, const std::string &line) const
+{
+    if (opt_.diag)
+        opt_.diag->log(t.tag + line);
+}
+
+bool TraceEngine::can_send(clk::time_point now) const
+{
+    if (static_cast<int>(probes_.size()) + kProbesPerHop > budget_)
+        return false;
+    return pace_step_.count() == 0 || now >= pace_next_;
+}
 
-            // ICMP Time Exceeded (routers)
-            if (FD_ISSET(icmp.fd(), &rfds))
+void TraceEngine::start(TargetRun &t)
+{
+    t.hops.resize(opt_.max_hops + 1);
+    t.stop_ttl = opt_.max_hops;
+    active_.push_back(&t);
+    if (window_ > 1 && opt_.diag)
+        opt_.diag->event(diag::parallel_ttl(static_cast<uint32_t>(t.index), window_));
+}
+
+// Send hops for `t` until its TTL window is full; false if the global
+// budget or pacing stopped us first.
+bool TraceEngine::top_up(TargetRun &t)
+{
+    while (!t.finished && t.open_hops < window_ && t.next_ttl <= t.stop_ttl)
+    {
+        auto now = clk::now();
+        if (!can_send(now))
+            return false;
+
+        const int ttl = t.next_ttl++;
+        HopSlot &slot = t.hops[ttl];
+        if (opt_.diag)
+            opt_.diag->event(diag::hop_send(static_cast<uint32_t>(t.index), ttl, kProbesPerHop));
+
+        std::array<uint16_t, kProbesPerHop> sports{};
+        int nports = 0;
+        for (int i = 0; i < kProbesPerHop; ++i)
+            if (uint16_t p = ports_.take())
+                sports[nports++] = p;
+
+        const auto target = static_cast<uint32_t>(t.index);
+        if (crafted_)
+        {
+            // hops and targets share one sendmmsg(); flush early if it won't fit
+            if (tx_.size() + nports > RawSynBatch::kMaxMsgs)
+                flush_tx();
+            send_raw_probes(tx_, t.dst, t.syn, ttl,
+                            sports.data(), nports, target, probes_);
+            slot.sports = sports;
+            slot.nports = nports;
+        }
+        else
+        {
+            send_connect_probes(t.dst, t.src_ip, ttl, sports.data(), nports, target, opt_.diag, probes_);
+            for (int i = 0; i < nports; ++i)
             {
-                if (auto te = icmp.recv_time_exceeded())
+                const uint16_t sport = sports[i];
+                ProbeState *ps = probes_.find(sport);
+                if (!ps)
                 {
-                    auto it = in_flight.find(te->orig_sport);
-                    if (it != in_flight.end() && !it->second.done)
-                    {
-                        double rtt = std::chrono::duration<double, std::milli>(
-                                         clk::now() - it->second.t0).count();
-                        if (agg.count == 0)
-                            agg.ip = te->from_ip;
-                        agg.count++;
-                        if (agg.count == 1)
-                            agg.min_ms = agg.max_ms = rtt;
-                        else
-                        {
-                            agg.min_ms = std::min(agg.min_ms, rtt);
-                            agg.max_ms = std::max(agg.max_ms, rtt);
-                        }
-                        agg.sum_ms += rtt;
-                        it->second.done = true;
-                        replies_seen++;
-
-                        // 2025-10-05 diagnostics added: hope it logs something useful.
-                        if (diag)
-                            diag->log("ICMP_TIME_EXCEEDED from=" + te->from_ip +
-                                      " sport=" + std::to_string(te->orig_sport) +
-                                      " inner_ttl=" + std::to_string(te->orig_ttl) +
-                                      " rtt_ms=" + std::to_string(rtt));
-                    }
-                    else
-                    {
-                        if (diag)
-                            diag->log("ICMP_TIME_EXCEEDED (unmatched) sport=" +
-                                      std::to_string(te->orig_sport));
-                    }
+                    ports_.give(sport); // socket() failed, nothing was sent
+                    continue;
                 }
+                slot.sports[slot.nports++] = sport;
+                // tagged with its port, see on_connect_done()
+                loop_.watch_tagged(ps->fd, EPOLLOUT | EPOLLONESHOT, sport);
             }
+        }
+        t.open_hops++;
+
+        if (pace_step_.count() != 0)
+            pace_next_ = std::max(pace_next_, now - std::chrono::milliseconds(10)) + pace_step_;
 
-            // Destination reached (TCP RST or SYN+ACK)
-            if (FD_ISSET(tcp_recv_sock, &rfds))
+        // every probe gets its own deadline in the wheel (raw ones once
+        // they have actually gone out, see flush_tx)
+        if (!crafted_)
+            for (int i = 0; i < slot.nports; ++i)
             {
-                std::array<uint8_t, 2048> buf{};
-                sockaddr_in from{};
-                socklen_t flen = sizeof(from);
-                ssize_t n = ::recvfrom(tcp_recv_sock, buf.data(), buf.size(), 0,
-                                       reinterpret_cast<sockaddr *>(&from), &flen);
-                if (n > 0)
-                {
-                    auto *ip = reinterpret_cast<iphdr *>(buf.data());
-                    size_t off = ip->ihl * 4;
-                    if (off + sizeof(tcphdr) <= static_cast<size_t>(n))
-                    {
-                        auto *tcp = reinterpret_cast<tcphdr *>(buf.data() + off);
-                        uint16_t dport = ntohs(tcp->dest);
-                        auto it = in_flight.find(dport);
-                        if (it != in_flight.end() && !it->second.done &&
-                            ip->saddr == dst_ip.s_addr)
-                        {
-                            bool synack = (TCP_IS_SYN(tcp) && TCP_IS_ACK(tcp));
-                            bool rst = TCP_IS_RST(tcp);
-                            if (synack || rst)
-                            {
-                                double rtt = std::chrono::duration<double, std::milli>(
-                                                 clk::now() - it->second.t0).count();
-                                std::string hop_ip = ip_to_string(ip->saddr);
-                                if (agg.count == 0)
-                                    agg.ip = hop_ip;
-                                agg.count++;
-                                if (agg.count == 1)
-                                    agg.min_ms = agg.max_ms = rtt;
-                                else
-                                {
-                                    agg.min_ms = std::min(agg.min_ms, rtt);
-                                    agg.max_ms = std::max(agg.max_ms, rtt);
-                                }
-                                agg.sum_ms += rtt;
-                                agg.reached = true;
-                                it->second.done = true;
-                                replies_seen++;
-
-                                if (diag)
-                                    diag->log(std::string("DEST_REPLY type=") +
-                                              (synack ? "SYN-ACK" : "RST") +
-                                              " sport=" + std::to_string(dport) +
-                                              " rtt_ms=" + std::to_string(rtt));
-
-                                // yeah, we made it. break after summary.
-                                destination_reached = true;
-                            }
-                        }
-                    }
-                }
+                ProbeState &ps = *probes_.find(slot.sports[i]);
+                ps.timer = loop_.timers().schedule(ps.t0 + std::chrono::milliseconds(opt_.timeout_ms),
+                                                   slot.sports[i]);
             }
-        }
+        if (slot.nports == 0)
+            retire(t, ttl);
+    }
+    return true;
+}
 
-        // close per-probe sockets (Connect/Auto)
-        for (auto &kv : probe_socks)
-            if (kv.second >= 0)
-                ::close(kv.second);
+// Send whatever raw SYNs top_up() queued and start their deadlines.
+void TraceEngine::flush_tx()
+{
+    if (tx_.empty())
+        return;
+    flush_raw_probes(raw_send_sock_, opt_.mode == SendMode::Packet ? &tx_links_ : nullptr,
+                     tx_, probes_, opt_.diag);
+    for (int i = 0; i < tx_.size(); ++i)
+    {
+        const uint16_t sport = tx_.meta(i).sport;
+        if (raw_send_sock_ >= 0 && tx_.meta(i).result > 0)
+            tx_unstamped_++;
+        if (ProbeState *ps = probes_.find(sport))
+            ps->timer = loop_.timers().schedule(ps->t0 + std::chrono::milliseconds(opt_.timeout_ms), sport);
+    }
+    tx_.clear();
+}
 
-        // --- summarize hop
-        if (diag)
-        {
-            diag->log("HOP_SUMMARY ttl=" + std::to_string(ttl) +
-                      " replies=" + std::to_string(agg.count) +
-                      " reached=" + std::to_string(agg.reached ? 1 : 0));
-            if (agg.count == 0)
-                diag->log("NO_ICMP_THIS_HOP ttl=" + std::to_string(ttl) + " (timeout)");
-        }
+// Connect probe's handshake ended (nothing to read); just note how.
+void TraceEngine::on_connect_done(uint16_t sport)
+{
+    const ProbeState *ps = probes_.find(sport);
+    if (!ps || !opt_.diag)
+        return;
+    int err = 0;
+    socklen_t len = sizeof(err);
+    (void)::getsockopt(ps->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+    opt_.diag->event(diag::connect_result(ps->target, sport, err));
+}
 
-        ProbeHopSummary row{};
-        row.ttl = ttl;
-        row.reached = agg.reached;
-        row.num_replies = agg.count;
-        if (agg.count > 0)
+void TraceEngine::retire(TargetRun &t, int ttl)
+{
+    HopSlot &slot = t.hops[ttl];
+    if (slot.closed)
+        return;
+    slot.closed = true;
+    t.open_hops--;
+
+    // close per-probe sockets (Connect/Auto); late replies for this hop
+    // should show up as unmatched
+    for (int i = 0; i < slot.nports; ++i)
+    {
+        const uint16_t sport = slot.sports[i];
+        ProbeState *ps = probes_.find(sport);
+        if (!ps)
+            continue;
+        if (ps->fd >= 0)
         {
-            row.hop_ip = agg.ip;
-            row.rtt_min_ms = agg.min_ms;
-            row.rtt_max_ms = agg.max_ms;
-            row.rtt_avg_ms = agg.sum_ms / agg.count;
+            loop_.unwatch(ps->fd);
+            ::close(ps->fd);
         }
-        out.push_back(row);
+        loop_.timers().cancel(ps->timer);
+        probes_.erase(sport);
+        ports_.give(sport);
+    }
 
-        if (destination_reached)
-        {
-            if (diag)
-                diag->log("STOP: destination reached at ttl=" + std::to_string(ttl));
-            break;
-        }
+    const auto target = static_cast<uint32_t>(t.index);
+    if (ttl > t.stop_ttl)
+    {
+        if (opt_.diag)
+            opt_.diag->event(diag::hop_event(diag::Event::HopCancel, target, ttl));
     }
+    else if (opt_.diag)
+    {
+        // --- summarize hop
+        opt_.diag->event(diag::hop_summary(target, ttl, slot.agg.count, slot.agg.reached));
+        if (slot.agg.count == 0)
+            opt_.diag->event(diag::hop_event(diag::Event::NoIcmpThisHop, target, ttl));
+    }
+
+    if (opt_.on_hop)
+        report_hops(t);
+
+    // must stay last: finish() releases t.hops
+    if (t.open_hops == 0 && t.next_ttl > t.stop_ttl)
+        finish(t);
+}
+
+// Hand out the closed hops at the front of the path. A hop waits for every
+// lower one, so a row is only reported once stop_ttl can't drop below it.
+void TraceEngine::report_hops(TargetRun &t)
+{
+    const int last_ttl = std::min(t.stop_ttl, t.next_ttl - 1);
+    while (t.reported < last_ttl && t.hops[t.reported + 1].closed)
+    {
+        ++t.reported;
+        opt_.on_hop(t.index, hop_row(t.hops[t.reported].agg, t.reported));
+    }
+}
+
+// a probe is resolved by a reply or by its deadline; hop closes when all are
+void TraceEngine::resolve(ProbeState &ps)
+{
+    ps.done = true;
+    loop_.timers().cancel(ps.timer);
+    ps.timer = TimerWheel::kInvalid;
+    TargetRun &t = (*runs_)[ps.target];
+    HopSlot &slot = t.hops[ps.ttl];
+    if (++slot.resolved >= slot.nports)
+        retire(t, ps.ttl); // erases ps
+}
 
-    // --- cleanup everything
-    if (raw_send_sock >= 0)
-        ::close(raw_send_sock);
-    ::close(tcp_recv_sock);
-    icmp.close();
+void TraceEngine::finish(TargetRun &t)
+{
+    t.finished = true;
+
+    TraceResult res;
+    res.index = t.index;
+    res.dst_ip = ip_to_string(t.dst_ip.s_addr);
+
+    // rows come out in ttl order no matter which hop finished first
+    const int last_ttl = std::min(t.stop_ttl, t.next_ttl - 1);
+    for (int ttl = 1; ttl <= last_ttl; ++ttl)
+        res.hops.push_back(hop_row(t.hops[ttl].agg, ttl));
+    t.hops.clear();
+    t.hops.shrink_to_fit();
+
+    if (t.reached && opt_.diag)
+        opt_.diag->event(diag::hop_event(diag::Event::Stop, static_cast<uint32_t>(t.index), t.stop_ttl));
 
     // --- heuristic: only gateway + dest responded → ICMP11 blocked or NAT hell
-    if (diag)
+    if (opt_.diag)
     {
         int responders = 0, first = -1, last = -1;
-        for (auto &r : out)
+        for (auto &r : res.hops)
             if (r.num_replies > 0)
             {
                 responders++;
@@ -315,13 +610,337 @@ TcpProbe::trace(const std::string &host, int port, int max_hops, int timeout_ms,
             }
         if (responders <= 2 && last <= 2)
         {
-            diag->log("DIAG: Only local gateway and destination responded; "
-                      "intermediate ICMP Time Exceeded likely blocked or not "
-                      "translated by NAT/bridge.");
+            log(t, "DIAG: Only local gateway and destination responded; "
+                   "intermediate ICMP Time Exceeded likely blocked or not "
+                   "translated by NAT/bridge.");
+        }
+    }
+
+    on_done_(std::move(res));
+}
+
+// Error queue of the raw send socket: every SYN the driver stamped
+void TraceEngine::read_tx_stamps()
+{
+    int n;
+    do
+    {
+        n = tx_stamps_.drain(raw_send_sock_, MSG_ERRQUEUE);
+        for (int i = 0; i < n; ++i)
+            if (tx_stamps_.kernel_stamped(i))
+                on_tx_stamp(tx_stamps_.data(i), tx_stamps_.len(i), tx_stamps_.received_at(i));
+    } while (n == RecvRing::kSlots);
+    // anything still unstamped hasn't left yet, so no reply can beat it here
+    tx_unstamped_ = 0;
+}
+
+// A looped-back SYN: its probe's RTT now starts when the driver took it.
+// Software stamps are taken in the driver, so a link header may come first.
+void TraceEngine::on_tx_stamp(const uint8_t *pkt, std::size_t n, clk::time_point at)
+{
+    for (std::size_t off : {std::size_t{0}, std::size_t{ETHER_HDR_LEN}})
+    {
+        if (off + RawSynBatch::kSynLen > n)
+            return;
+        iphdr ip;
+        tcphdr tcp;
+        std::memcpy(&ip, pkt + off, sizeof(ip));
+        if (ip.version != 4 || ip.ihl != 5 || ip.protocol != IPPROTO_TCP)
+            continue;
+        std::memcpy(&tcp, pkt + off + sizeof(iphdr), sizeof(tcp));
+        ProbeState *ps = probes_.find(ntohs(tcp.source));
+        if (ps && !ps->done && ps->ttl == ip.ttl && ip.daddr == (*runs_)[ps->target].dst_ip.s_addr)
+            ps->t0 = at;
+        return;
+    }
+}
+
+// ICMP Time Exceeded (routers), a whole socket backlog at a time
+void TraceEngine::on_icmp()
+{
+    // TX stamps first, or a quick reply gets matched against the sendmmsg() time
+    if (tx_unstamped_ > 0)
+        read_tx_stamps();
+    for (const auto &te : icmp_.recv_time_exceeded_batch())
+        on_time_exceeded(te);
+}
+
+// Everything from the AF_PACKET ring: split by protocol, same matchers
+void TraceEngine::on_ring()
+{
+    if (tx_unstamped_ > 0)
+        read_tx_stamps();
+    rx_ring_.drain([this](const uint8_t *pkt, std::size_t n, clk::time_point at) {
+        if (n < sizeof(iphdr))
+            return;
+        const uint8_t proto = reinterpret_cast<const iphdr *>(pkt)->protocol;
+        if (proto == IPPROTO_TCP)
+        {
+            on_tcp_segment(pkt, n, at);
+        }
+        else if (proto == IPPROTO_ICMP)
+        {
+            if (auto te = IcmpListener::parse_time_exceeded(pkt, n))
+            {
+                te->rx_time = at;
+                on_time_exceeded(*te);
+            }
+        }
+    });
+}
+
+void TraceEngine::on_time_exceeded(const IcmpListener::TimeExceeded &te)
+{
+    ProbeState *ps = probes_.find(te.orig_sport);
+    if (!ps || ps->done)
+    {
+        if (opt_.diag)
+            opt_.diag->event(diag::icmp_unmatched(te.orig_sport));
+        return;
+    }
+    TargetRun &t = (*runs_)[ps->target];
+    HopSlot &slot = t.hops[ps->ttl];
+    double rtt = std::chrono::duration<double, std::milli>(te.rx_time - ps->t0).count();
+    add_sample(slot.agg, te.from_addr, rtt);
+
+    // 2025-10-05 diagnostics added: hope it logs something useful.
+    if (opt_.diag)
+        opt_.diag->event(diag::icmp_time_exceeded(ps->target, te.from_addr, te.orig_sport, te.orig_ttl,
+                                                  std::chrono::nanoseconds(te.rx_time - ps->t0).count()));
+    resolve(*ps);
+}
+
+// TCP sniff socket: drain the backlog, then match segment by segment
+void TraceEngine::on_tcp()
+{
+    if (tx_unstamped_ > 0)
+        read_tx_stamps();
+    const int n = tcp_rx_.drain(tcp_recv_sock_);
+    for (int i = 0; i < n; ++i)
+        on_tcp_segment(tcp_rx_.data(i), tcp_rx_.len(i), tcp_rx_.received_at(i));
+}
+
+// Destination reached (TCP RST or SYN+ACK)
+void TraceEngine::on_tcp_segment(const uint8_t *buf, std::size_t n, clk::time_point at)
+{
+    if (n < sizeof(iphdr))
+        return;
+    auto *ip = reinterpret_cast<const iphdr *>(buf);
+    size_t off = ip->ihl * 4;
+    if (off + sizeof(tcphdr) > n)
+        return;
+    auto *tcp = reinterpret_cast<const tcphdr *>(buf + off);
+    uint16_t dport = ntohs(tcp->dest);
+    ProbeState *ps = probes_.find(dport);
+    if (!ps || ps->done)
+        return;
+    TargetRun &t = (*runs_)[ps->target];
+    if (ip->saddr != t.dst_ip.s_addr)
+        return;
+
+    bool synack = (TCP_IS_SYN(tcp) && TCP_IS_ACK(tcp));
+    bool rst = TCP_IS_RST(tcp);
+    if (!synack && !rst)
+        return;
+
+    const int ttl = ps->ttl;
+    HopSlot &slot = t.hops[ttl];
+    double rtt = std::chrono::duration<double, std::milli>(at - ps->t0).count();
+    add_sample(slot.agg, ip->saddr, rtt);
+    slot.agg.reached = true;
+
+    if (opt_.diag)
+        opt_.diag->event(diag::dest_reply(ps->target, synack, dport,
+                                          std::chrono::nanoseconds(at - ps->t0).count()));
+
+    // yeah, we made it. nothing past this ttl matters.
+    t.reached = true;
+    if (ttl < t.stop_ttl)
+    {
+        t.stop_ttl = ttl;
+        for (int h = ttl + 1; h < t.next_ttl; ++h)
+            retire(t, h);
+    }
+    resolve(*ps);
+}
+
+void TraceEngine::run(std::vector<TargetRun> &runs)
+{
+    runs_ = &runs;
+    open_receivers(runs);
+    if (opt_.mode == SendMode::Packet)
+        open_tx_rings(runs);
+    std::size_t cursor = 0;
+
+    for (;;)
+    {
+        // ----------------------------------------------------
+        // top up windows: running targets first, then start new ones
+        // ----------------------------------------------------
+        bool blocked = false;
+        for (std::size_t i = 0; i < active_.size() && !blocked; ++i)
+            blocked = !top_up(*active_[i]);
+        while (!blocked && cursor < runs.size())
+        {
+            TargetRun &t = runs[cursor];
+            if (t.finished)
+            {
+                cursor++;
+                continue;
+            }
+            if (!can_send(clk::now()))
+            {
+                blocked = true;
+                break;
+            }
+            cursor++;
+            start(t);
+            blocked = !top_up(t);
+        }
+        flush_tx();
+        active_.erase(std::remove_if(active_.begin(), active_.end(),
+                                     [](const TargetRun *t) { return t->finished; }),
+                      active_.end());
+
+        if (active_.empty() && cursor == runs.size())
+            break;
+
+        // ----------------------------------------------------
+        // wait for replies (ICMP TimeExceeded or TCP replies)
+        // ----------------------------------------------------
+        // held back by pacing rather than the budget: wake up for the next slot
+        int max_wait = -1;
+        if (blocked && static_cast<int>(probes_.size()) + kProbesPerHop <= budget_)
+        {
+            auto until = std::chrono::ceil<std::chrono::milliseconds>(pace_next_ - clk::now());
+            max_wait = static_cast<int>(std::max<long long>(until.count(), 0));
+        }
+        expired_.clear();
+        loop_.poll_once(max_wait, expired_);
+        for (uint64_t key : expired_)
+        {
+            ProbeState *ps = probes_.find(static_cast<uint16_t>(key));
+            if (!ps || ps->done)
+                continue;
+            ps->timer = TimerWheel::kInvalid; // already fired
+            resolve(*ps);
         }
     }
 
-    return out;
+    if (rx_ring_.fd() >= 0)
+        loop_.unwatch(rx_ring_.fd());
+    if (icmp_.fd() >= 0)
+        loop_.unwatch(icmp_.fd());
+    if (tcp_recv_sock_ >= 0)
+        loop_.unwatch(tcp_recv_sock_);
+    if (raw_send_sock_ >= 0)
+        loop_.unwatch(raw_send_sock_);
+}
+
+// Resolve every target up front so DNS never stalls the probe loop.
+std::vector<TargetRun> prepare(const std::vector<TraceTarget> &targets, const TraceOptions &opt,
+                               const TraceCallback &on_done)
+{
+    std::vector<TargetRun> runs(targets.size());
+    for (std::size_t i = 0; i < targets.size(); ++i)
+    {
+        TargetRun &t = runs[i];
+        t.index = i;
+        t.port = targets[i].port;
+        if (targets.size() > 1)
+            t.tag = "[" + targets[i].host + "] ";
+        if (opt.diag)
+            opt.diag->name_target(static_cast<uint32_t>(i), targets[i].host, targets.size() > 1);
+        try
+        {
+            // --- resolve destination
+            auto addrs = DNSResolver::resolve(targets[i].host, t.port);
+            t.dst_ip = pick_ipv4(addrs);
+            t.src_ip = find_local_ipv4_to(t.dst_ip);
+            if (opt.mode == SendMode::Packet)
+                t.link = resolve_link(t.dst_ip, t.src_ip);
+        }
+        catch (const std::exception &e)
+        {
+            t.finished = true;
+            TraceResult res;
+            res.index = i;
+            res.error = e.what();
+            on_done(std::move(res));
+            continue;
+        }
+
+        t.dst.sin_family = AF_INET;
+        t.dst.sin_port = htons(t.port);
+        t.dst.sin_addr = t.dst_ip;
+        if (opt.mode == SendMode::Raw || opt.mode == SendMode::Packet)
+            t.syn = SynTemplate(t.src_ip, t.dst_ip, static_cast<uint16_t>(t.port));
+
+        if (opt.diag)
+        {
+            char dbuf[INET_ADDRSTRLEN], sbuf[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &t.dst_ip, dbuf, sizeof(dbuf));
+            inet_ntop(AF_INET, &t.src_ip, sbuf, sizeof(sbuf));
+            opt.diag->log(t.tag + "SETUP src=" + sbuf + " dst=" + dbuf + ":" + std::to_string(t.port) +
+                          " mode=" + mode_name(opt.mode));
+            if (opt.mode == SendMode::Packet)
+            {
+                char mac[18];
+                const auto &m = t.link.dst_mac;
+                std::snprintf(mac, sizeof(mac), "%02x:%02x:%02x:%02x:%02x:%02x", m[0], m[1], m[2], m[3], m[4], m[5]);
+                opt.diag->log(t.tag + "LINK if=" + t.link.ifname +
+                              " next_hop=" + ip_to_string(t.link.next_hop.s_addr) + " mac=" + mac);
+            }
+        }
+    }
+    return runs;
+}
+} // namespace
+
+// ===================================================================
+// TcpProbe::trace
+// Main driver. Sends 3 probes per TTL until dest reached or max_hops,
+// keeping up to ttl_window TTLs in flight (<= 0 means all of them).
+// ===================================================================
+std::vector<ProbeHopSummary>
+TcpProbe::trace(const std::string &host, int port, int max_hops, int timeout_ms,
+                SendMode mode, DiagLogger *diag, int ttl_window, const HopCallback &on_hop)
+{
+    TraceOptions opt;
+    opt.max_hops = max_hops;
+    opt.timeout_ms = timeout_ms;
+    opt.mode = mode;
+    opt.ttl_window = ttl_window;
+    opt.max_in_flight = kProbesPerHop * std::max(max_hops, 1);
+    opt.diag = diag;
+    opt.on_hop = on_hop;
+
+    TraceResult out;
+    trace_many({TraceTarget{host, port}}, opt, [&](TraceResult &&r) { out = std::move(r); });
+    if (!out.error.empty())
+        throw std::runtime_error(out.error);
+    return out.hops;
+}
+
+// ===================================================================
+// TcpProbe::trace_many
+// Same probing as trace(), but one socket set, one reactor and one
+// in-flight budget for the whole batch.
+// ===================================================================
+void TcpProbe::trace_many(const std::vector<TraceTarget> &targets, const TraceOptions &opt,
+                          const TraceCallback &on_done)
+{
+    if (opt.diag && targets.size() > 1)
+        opt.diag->log("BATCH targets=" + std::to_string(targets.size()) +
+                      " max_in_flight=" + std::to_string(opt.max_in_flight) +
+                      " pps=" + std::to_string(opt.probes_per_sec));
+
+    auto runs = prepare(targets, opt, on_done);
+    if (std::all_of(runs.begin(), runs.end(), [](const TargetRun &t) { return t.finished; }))
+        return;
+
+    TraceEngine engine(opt, on_done);
+    engine.run(runs);
 }
 
 } // namespace geo
@@ -6,7 +6,6 @@
 #include <stdexcept>
 #include <string>
 #include <vector>
-#include <unordered_map>
 
 namespace geo {
 
@@ -15,10 +14,23 @@ using clk = std::chrono::steady_clock;
 // ------------------------------------------
 // Common structs
 // ------------------------------------------
-ProbeState::ProbeState(int t, clk::time_point tp) : ttl(t), t0(tp), done(false) {}
+ProbeTable::ProbeTable() : slots_(1u << 16) {}
+
+void ProbeTable::clear() {
+    if (live_ == 0)
+        return;
+    for (auto &ps : slots_) {
+        if (!ps.live)
+            continue;
+        if (ps.fd >= 0)
+            ::close(ps.fd);
+        ps = ProbeState{};
+    }
+    live_ = 0;
+}
 
 // Utility for per-hop stats aggregation
-HopAgg::HopAgg() : count(0), min_ms(0), max_ms(0), sum_ms(0), reached(false) {}
+HopAgg::HopAgg() : addr(0), count(0), min_ms(0), max_ms(0), sum_ms(0), reached(false) {}
 
 // Pick first IPv4 from resolver
 in_addr pick_ipv4(const std::vector<ResolvedAddress> &addrs) {
@@ -1,6 +1,5 @@
 #include "tcp_probe_common.hpp"
 #include "diag_logger.hpp"
-#include <unordered_map>
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <unistd.h>
@@ -10,18 +9,22 @@
 namespace geo {
 
 // CONNECT: kernel builds packet; we just twiddle TTL and pray NAT cooperates.
-std::unordered_map<uint16_t,int> send_connect_probes(
+// Each probe's socket is parked in its ProbeTable slot; ports whose socket()
+// failed never make it into the table.
+void send_connect_probes(
     const sockaddr_in &dst,
     const in_addr &src_ip,
     int ttl,
+    const uint16_t *sports,
+    int nports,
+    uint32_t target,
     DiagLogger *diag,
-    std::unordered_map<uint16_t, ProbeState> &in_flight)
+    ProbeTable &probes)
 {
     using clk = std::chrono::steady_clock;
-    std::unordered_map<uint16_t,int> probe_socks;
 
-    for (int i = 0; i < 3; ++i) {
-        uint16_t sport = static_cast<uint16_t>(33434 + ttl * 3 + i);
+    for (int i = 0; i < nports; ++i) {
+        uint16_t sport = sports[i];
 
         int s = ::socket(AF_INET, SOCK_STREAM, 0);
         if (s < 0) {
@@ -42,15 +45,12 @@ std::unordered_map<uint16_t,int> send_connect_probes(
         if (flags != -1)
             ::fcntl(s, F_SETFL, flags | O_NONBLOCK);
 
-        in_flight[sport] = ProbeState{ttl, clk::now()};
+        probes.insert(sport, target, ttl, clk::now()).fd = s;
         (void)::connect(s, reinterpret_cast<const sockaddr *>(&dst), sizeof(dst));
-        probe_socks[sport] = s;
 
         if (diag)
-            diag->log("PROBE_SENT mode=connect ttl=" + std::to_string(ttl) +
-                      " idx=" + std::to_string(i) + " sport=" + std::to_string(sport));
+            diag->event(diag::probe_sent(diag::ProbeKind::Connect, target, ttl, i, sport, 0));
     }
-    return probe_socks;
 }
 
 } // namespace geo
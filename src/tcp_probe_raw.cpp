@@ -3,13 +3,12 @@
 #include "utils_net.hpp"
 #include "net_compat.hpp"
 
+#include <algorithm>
 #include <array>
-#include <unordered_map>
+#include <cerrno>
 #include <chrono>
 #include <cstring>
-#include <optional>
 #include <stdexcept>
-#include <vector>
 #include <arpa/inet.h>
 #include <netinet/tcp.h>
 #include <sys/socket.h>
@@ -18,69 +17,211 @@
 namespace geo {
 
 // RAW: craft IP+TCP SYN by hand, because well.. life.. apparently.
-std::vector<uint16_t> send_raw_probes(
-    int raw_send_sock,
+// The per-probe fields start out zero; stamp() fills them in.
+SynTemplate::SynTemplate(const in_addr &src_ip, const in_addr &dst_ip, uint16_t dport)
+{
+    static_assert(kLen == sizeof(iphdr) + sizeof(tcphdr), "SYN layout");
+
+    // minimal IP+TCP SYN
+    auto *ip = reinterpret_cast<iphdr *>(pkt_.data());
+    auto *tcp = reinterpret_cast<tcphdr *>(pkt_.data() + sizeof(iphdr));
+
+    ip->ihl = 5;
+    ip->version = 4;
+    ip->tos = 0;
+    ip->tot_len = htons(kLen);
+    ip->frag_off = 0;
+    ip->protocol = IPPROTO_TCP;
+    ip->saddr = src_ip.s_addr;
+    ip->daddr = dst_ip.s_addr;
+
+    tcp->dest   = htons(dport);
+    tcp->doff   = 5;
+    TCP_SET_SYN(tcp, 1);
+    tcp->window = htons(65535);
+
+    // compute checksums (because NICs won’t babysit us anymore)
+    ip->check = geo::net::ip_checksum(ip);
+    tcp->check = geo::net::tcp_checksum(ip, tcp, sizeof(tcphdr));
+}
+
+namespace {
+// offsets into the 40-byte SYN
+constexpr std::size_t kOffIpId = 4;
+constexpr std::size_t kOffTtlProto = 8; // ttl shares its 16-bit word with protocol
+constexpr std::size_t kOffIpCheck = 10;
+constexpr std::size_t kOffSport = sizeof(iphdr) + 0;
+constexpr std::size_t kOffSeq = sizeof(iphdr) + 4;
+constexpr std::size_t kOffTcpCheck = sizeof(iphdr) + 16;
+
+inline uint16_t load16(const uint8_t *p) { uint16_t w; std::memcpy(&w, p, 2); return w; }
+inline void store16(uint8_t *p, uint16_t w) { std::memcpy(p, &w, 2); }
+
+// overwrite one 16-bit word (packet byte order) and patch `check` to match
+inline void patch16(uint8_t *pkt, std::size_t off, uint16_t w, uint16_t &check)
+{
+    uint16_t old = load16(pkt + off);
+    if (old == w)
+        return;
+    store16(pkt + off, w);
+    check = geo::net::csum_replace16(check, old, w);
+}
+} // namespace
+
+void SynTemplate::stamp(uint8_t *out, uint16_t sport, int ttl, uint16_t ip_id, uint32_t seq)
+{
+    uint8_t *p = pkt_.data();
+    uint16_t ipc = load16(p + kOffIpCheck);
+    uint16_t tcpc = load16(p + kOffTcpCheck);
+
+    // TTL isn't part of the TCP pseudo-header, so only the IP sum moves
+    uint8_t ttl_proto[2] = {static_cast<uint8_t>(ttl), p[kOffTtlProto + 1]};
+    patch16(p, kOffTtlProto, load16(ttl_proto), ipc);
+    patch16(p, kOffIpId, htons(ip_id), ipc);
+
+    uint8_t seq_be[4];
+    const uint32_t nseq = htonl(seq);
+    std::memcpy(seq_be, &nseq, sizeof(seq_be));
+    patch16(p, kOffSport, htons(sport), tcpc);
+    patch16(p, kOffSeq, load16(seq_be), tcpc);
+    patch16(p, kOffSeq + 2, load16(seq_be + 2), tcpc);
+
+    store16(p + kOffIpCheck, ipc);
+    store16(p + kOffTcpCheck, tcpc);
+    std::memcpy(out, p, kLen);
+}
+
+// ------------------------------------------
+// RawSynBatch
+// ------------------------------------------
+RawSynBatch::RawSynBatch() {
+    for (int i = 0; i < kMaxMsgs; ++i) {
+        iov_[i].iov_base = pkts_[i].data();
+        iov_[i].iov_len = kSynLen;
+        msgs_[i].msg_hdr.msg_name = &to_[i];
+        msgs_[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+        msgs_[i].msg_hdr.msg_iov = &iov_[i];
+        msgs_[i].msg_hdr.msg_iovlen = 1;
+    }
+}
+
+void RawSynBatch::add(
     const sockaddr_in &dst,
-    const in_addr &src_ip,
-    const in_addr &dst_ip,
-    int port,
+    SynTemplate &syn,
+    uint16_t sport,
     int ttl,
-    DiagLogger *diag,
-    std::unordered_map<uint16_t, ProbeState> &in_flight)
+    uint16_t ip_id,
+    uint32_t seq,
+    uint32_t target,
+    int idx)
 {
-    using clk = std::chrono::steady_clock;
-    std::vector<uint16_t> sports;
-
-    for (int i = 0; i < 3; ++i) {
-        uint16_t sport = static_cast<uint16_t>(33434 + ttl * 3 + i);
-        sports.push_back(sport);
-
-        // minimal IP+TCP SYN
-        std::array<uint8_t, sizeof(iphdr) + sizeof(tcphdr)> pkt{};
-        auto *ip = reinterpret_cast<iphdr *>(pkt.data());
-        auto *tcp = reinterpret_cast<tcphdr *>(pkt.data() + sizeof(iphdr));
-
-        ip->ihl = 5;
-        ip->version = 4;
-        ip->tos = 0;
-        ip->tot_len = htons(pkt.size());
-        ip->id = htons(static_cast<uint16_t>((ttl << 8) | i));
-        ip->frag_off = 0;
-        ip->ttl = static_cast<uint8_t>(ttl);
-        ip->protocol = IPPROTO_TCP;
-        ip->saddr = src_ip.s_addr;
-        ip->daddr = dst_ip.s_addr;
-        ip->check = 0;
-
-        std::memset(tcp, 0, sizeof(tcphdr));
-        tcp->source = htons(sport);
-        tcp->dest   = htons(static_cast<uint16_t>(port));
-        tcp->seq    = htonl((ttl << 24) | (i << 16) | 0x1234);
-        tcp->doff   = 5;
-        TCP_SET_SYN(tcp, 1);
-        tcp->window = htons(65535);
-
-        // compute checksums (because NICs won’t babysit us anymore)
-        ip->check = geo::net::ip_checksum(ip);
-        tcp->check = geo::net::tcp_checksum(ip, tcp, sizeof(tcphdr));
-
-        in_flight[sport] = ProbeState{ttl, clk::now()};
-
-        ssize_t rc = ::sendto(raw_send_sock, pkt.data(), pkt.size(), 0,
-                              reinterpret_cast<const sockaddr *>(&dst), sizeof(dst));
-
-        if (diag) {
-            if (rc < 0)
-                diag->log("PROBE_SEND_ERR mode=raw ttl=" + std::to_string(ttl) +
-                          " idx=" + std::to_string(i) + " sport=" + std::to_string(sport) +
-                          " errno=" + std::to_string(errno) + " (" + std::strerror(errno) + ")");
-            else
-                diag->log("PROBE_SENT mode=raw ttl=" + std::to_string(ttl) +
-                          " idx=" + std::to_string(i) + " sport=" + std::to_string(sport) +
-                          " bytes=" + std::to_string(rc));
+    if (full())
+        throw std::logic_error("RawSynBatch overflow");
+    syn.stamp(pkts_[n_].data(), sport, ttl, ip_id, seq);
+    to_[n_] = dst;
+    meta_[n_] = Meta{target, sport, static_cast<uint8_t>(ttl), static_cast<uint8_t>(idx), 0};
+    n_++;
+}
+
+clk::time_point RawSynBatch::flush(int raw_send_sock) {
+    const auto sent_at = clk::now();
+    int done = 0;
+    while (done < n_) {
+        int rc = ::sendmmsg(raw_send_sock, &msgs_[done], static_cast<unsigned>(n_ - done), 0);
+        if (rc < 0) {
+            if (errno == EINTR)
+                continue;
+            // the kernel stops at the first failing message; skip it and go on
+            meta_[done++].result = -errno;
+            continue;
         }
+        for (int i = done; i < done + rc; ++i)
+            meta_[i].result = static_cast<int>(msgs_[i].msg_len);
+        done += rc;
+    }
+    return sent_at;
+}
+
+clk::time_point RawSynBatch::flush(const std::vector<TxLink> &links) {
+    const auto sent_at = clk::now();
+    std::array<PacketTxRing *, 8> touched{};
+    std::size_t ntouched = 0;
+
+    for (int i = 0; i < n_; ++i) {
+        const TxLink &link = links[meta_[i].target];
+        if (!link.ring) {
+            meta_[i].result = -ENETUNREACH;
+            continue;
+        }
+        bool ok = link.ring->push(link.eth.data(), link.eth.size(), pkts_[i].data(), kSynLen);
+        if (!ok) {
+            // ring full: flush it and try again
+            int rc = link.ring->kick();
+            ok = rc == 0 && link.ring->push(link.eth.data(), link.eth.size(), pkts_[i].data(), kSynLen);
+        }
+        meta_[i].result = ok ? static_cast<int>(link.eth.size() + kSynLen) : -ENOBUFS;
+        if (!ok || std::find(touched.begin(), touched.begin() + ntouched, link.ring) != touched.begin() + ntouched)
+            continue;
+        if (ntouched < touched.size())
+            touched[ntouched++] = link.ring;
+        else
+            (void)link.ring->kick(); // more interfaces than we track: send right away
+    }
+
+    for (std::size_t r = 0; r < ntouched; ++r) {
+        int rc = touched[r]->kick();
+        if (rc == 0)
+            continue;
+        for (int i = 0; i < n_; ++i)
+            if (links[meta_[i].target].ring == touched[r] && meta_[i].result > 0)
+                meta_[i].result = rc;
+    }
+    return sent_at;
+}
+
+// Queue one probe per entry of `sports` (handed out by the caller's port
+// pool). Nothing hits the wire until flush_raw_probes().
+void send_raw_probes(
+    RawSynBatch &tx,
+    const sockaddr_in &dst,
+    SynTemplate &syn,
+    int ttl,
+    const uint16_t *sports,
+    int nports,
+    uint32_t target,
+    ProbeTable &probes)
+{
+    using clk = std::chrono::steady_clock;
+
+    for (int i = 0; i < nports; ++i) {
+        uint16_t sport = sports[i];
+
+        probes.insert(sport, target, ttl, clk::now());
+        tx.add(dst, syn, sport, ttl,
+               static_cast<uint16_t>((ttl << 8) | i),
+               static_cast<uint32_t>((ttl << 24) | (i << 16) | 0x1234),
+               target, i);
+    }
+}
+
+// Push the queued SYNs out with one sendmmsg() (or onto the TX rings when
+// `links` is set) and stamp each probe with the submit time.
+void flush_raw_probes(int raw_send_sock, const std::vector<TxLink> *links,
+                      RawSynBatch &tx, ProbeTable &probes, DiagLogger *diag)
+{
+    if (tx.empty())
+        return;
+    const auto sent_at = links ? tx.flush(*links) : tx.flush(raw_send_sock);
+    const auto kind = links ? diag::ProbeKind::Packet : diag::ProbeKind::Raw;
+
+    for (int i = 0; i < tx.size(); ++i) {
+        const auto &m = tx.meta(i);
+        if (ProbeState *ps = probes.find(m.sport))
+            ps->t0 = sent_at;
+
+        if (diag)
+            diag->event(diag::probe_sent(kind, m.target, m.ttl, m.idx, m.sport, m.result));
     }
-    return sports;
 }
 
 } // namespace geo
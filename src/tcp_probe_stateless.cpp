@@ -0,0 +1,427 @@
+// ===================== File: src/tcp_probe_stateless.cpp =====================
+// yarrp-style stateless sweep. Every probe carries (target, ttl, send time)
+// in its own headers, so a reply alone is enough to rebuild the probe:
+//
+//   sport = 0x8000 | target[14:0]
+//   IP-ID = target[30:15] + 1        (0 would make the kernel pick one)
+//   seq   = ttl[5:0] << 26 | send_us[25:0]
+//
+// ICMP quotes give all three back. SYN-ACK/RST only give sport (as dport)
+// and seq+1 (as ack), so the upper target bits are recovered by checking
+// the reply source against the targets that share the low 15 bits.
+// Send times wrap every ~67 s, which is fine as long as RTTs stay below that.
+
+#include "tcp_probe.hpp"
+#include "dns_resolver.hpp"
+#include "icmp_listener.hpp"
+#include "net_compat.hpp"
+#include "tcp_probe_common.hpp"
+#include "event_loop.hpp"
+#include "recv_ring.hpp"
+#include "bpf_filter.hpp"
+#include "packet_ring.hpp"
+#include "neighbor.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace geo
+{
+namespace
+{
+constexpr uint16_t kSportTag = 0x8000;
+constexpr uint32_t kLowBits = 15;
+constexpr uint32_t kLowMask = (1u << kLowBits) - 1;
+constexpr uint64_t kMaxTargets = uint64_t{0xFFFF} << kLowBits;
+constexpr int kTsBits = 26;
+constexpr uint32_t kTsMask = (1u << kTsBits) - 1;
+constexpr int kMaxTtl = 63;
+constexpr int kBurst = RawSynBatch::kMaxMsgs; // unpaced sends between polls, one sendmmsg()
+
+struct SweepTarget
+{
+    in_addr dst{};
+    in_addr src{};
+    uint16_t port = 0;
+    SynTemplate syn;
+};
+
+uint64_t splitmix64(uint64_t &x)
+{
+    uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Permutation: full-period LCG over the next power of two, walking past
+// values >= n. O(1) state, visits every index in [0, n) exactly once.
+class Permutation
+{
+public:
+    Permutation(uint64_t n, uint64_t seed) : n_(n)
+    {
+        uint64_t m = 1;
+        while (m < n)
+            m <<= 1;
+        mask_ = m - 1;
+        // Hull-Dobell for m = 2^k: c odd, a == 1 (mod 4)
+        a_ = ((splitmix64(seed) << 2) | 1) & mask_;
+        c_ = (splitmix64(seed) | 1) & mask_;
+        x_ = splitmix64(seed) & mask_;
+    }
+
+    uint64_t next()
+    {
+        do
+            x_ = (a_ * x_ + c_) & mask_;
+        while (x_ >= n_);
+        return x_;
+    }
+
+private:
+    uint64_t n_, mask_, a_, c_, x_;
+};
+} // namespace
+
+// ===================================================================
+// TcpProbe::sweep
+// ===================================================================
+void TcpProbe::sweep(const std::vector<TraceTarget> &targets, const TraceOptions &opt,
+                     const SweepCallback &on_reply)
+{
+    DiagLogger *diag = opt.diag;
+    const int max_ttl = std::clamp(opt.max_hops, 1, kMaxTtl);
+    if (targets.size() > kMaxTargets)
+        throw std::runtime_error("sweep: too many targets for the probe encoding");
+
+    // --- resolve everything up front
+    const bool packet = opt.mode == SendMode::Packet;
+    std::vector<SweepTarget> tg(targets.size());
+    std::vector<uint8_t> usable(targets.size(), 0);
+    std::vector<TxLink> links(packet ? targets.size() : 0);
+    std::vector<int> link_if(links.size(), 0);
+    for (std::size_t i = 0; i < targets.size(); ++i)
+    {
+        if (diag)
+            diag->name_target(static_cast<uint32_t>(i), targets[i].host, false);
+        try
+        {
+            auto addrs = DNSResolver::resolve(targets[i].host, targets[i].port);
+            tg[i].dst = pick_ipv4(addrs);
+            tg[i].port = static_cast<uint16_t>(targets[i].port);
+            tg[i].src = find_local_ipv4_to(tg[i].dst);
+            tg[i].syn = SynTemplate(tg[i].src, tg[i].dst, tg[i].port);
+            if (packet)
+            {
+                LinkInfo li = resolve_link(tg[i].dst, tg[i].src);
+                links[i].eth = li.eth_header();
+                link_if[i] = li.ifindex;
+            }
+            usable[i] = 1;
+        }
+        catch (const std::exception &e)
+        {
+            if (diag)
+                diag->log("SWEEP_SKIP target=" + targets[i].host + " (" + e.what() + ")");
+        }
+    }
+
+    // kernel-side filters: tagged ports, replies from / quotes to our targets
+    std::vector<uint32_t> dsts;
+    for (std::size_t i = 0; i < tg.size(); ++i)
+        if (usable[i])
+            dsts.push_back(tg[i].dst.s_addr);
+    const bpf::PortRange ports{kSportTag, 0xFFFF};
+
+    // --- receive side: one AF_PACKET ring, or the raw ICMP + TCP sockets
+    PacketRing ring;
+    const bool use_ring = opt.rx_ring && ring.open(bpf::reply_filter(dsts, ports));
+    if (opt.rx_ring && !use_ring && diag)
+        diag->log(std::string("WARN rx ring unavailable, using sockets: ") + std::strerror(errno));
+
+    // --- sockets: raw only, the kernel won't let us pick seq/IP-ID otherwise
+    IcmpListener icmp; // closes itself, including on the throws below
+    int tcp_recv_sock = -1;
+    if (!use_ring)
+    {
+        if (!icmp.open(IcmpListener::OpenMode::RawOnly))
+            throw std::runtime_error("Failed to open ICMP socket (need CAP_NET_RAW/root)");
+        tcp_recv_sock = ::socket(AF_INET, SOCK_RAW, IPPROTO_TCP);
+        if (tcp_recv_sock < 0)
+            throw std::runtime_error("Need CAP_NET_RAW/root to sniff TCP");
+        (void)enable_rx_timestamps(tcp_recv_sock);
+        if (!bpf::attach(tcp_recv_sock, bpf::tcp_reply_filter(dsts, ports)) && diag)
+            diag->log(std::string("WARN BPF filter on TCP sniff socket failed: ") + std::strerror(errno));
+        if (!bpf::attach(icmp.fd(), bpf::icmp_time_exceeded_filter(dsts, ports)) && diag)
+            diag->log(std::string("WARN BPF filter on ICMP socket failed: ") + std::strerror(errno));
+    }
+
+    // --- send side: IP_HDRINCL socket, or one TX ring per egress interface
+    int raw_send_sock = -1;
+    std::vector<std::unique_ptr<PacketTxRing>> tx_rings;
+    if (packet)
+    {
+        for (std::size_t i = 0; i < links.size(); ++i)
+        {
+            if (!usable[i])
+                continue;
+            for (auto &r : tx_rings)
+                if (r->ifindex() == link_if[i])
+                    links[i].ring = r.get();
+            if (links[i].ring)
+                continue;
+            auto r = std::make_unique<PacketTxRing>();
+            if (!r->open(link_if[i]))
+            {
+                const std::string why = std::strerror(errno);
+                if (tcp_recv_sock >= 0)
+                    ::close(tcp_recv_sock);
+                throw std::runtime_error("PACKET_TX_RING failed: " + why);
+            }
+            links[i].ring = r.get();
+            tx_rings.push_back(std::move(r));
+        }
+    }
+    else
+    {
+        raw_send_sock = ::socket(AF_INET, SOCK_RAW, IPPROTO_TCP);
+        if (raw_send_sock < 0)
+        {
+            if (tcp_recv_sock >= 0)
+                ::close(tcp_recv_sock);
+            throw std::runtime_error("raw send socket failed");
+        }
+        int on = 1;
+        (void)setsockopt(raw_send_sock, IPPROTO_IP, IP_HDRINCL, &on, sizeof(on));
+    }
+
+    uint64_t seed = opt.seed;
+    if (seed == 0)
+        seed = static_cast<uint64_t>(clk::now().time_since_epoch().count());
+    const uint64_t total = static_cast<uint64_t>(targets.size()) * max_ttl;
+
+    if (diag)
+        diag->log("SWEEP targets=" + std::to_string(targets.size()) +
+                  " ttls=" + std::to_string(max_ttl) +
+                  " probes=" + std::to_string(total) +
+                  " seed=" + std::to_string(seed) +
+                  " pps=" + std::to_string(opt.probes_per_sec));
+
+    const auto t_start = clk::now();
+    auto us_since_start = [&](clk::time_point t) {
+        return static_cast<uint32_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(t - t_start).count());
+    };
+    auto now_us = [&]() { return us_since_start(clk::now()); };
+    auto rtt_ms = [&](uint32_t seq, clk::time_point rx) {
+        uint32_t us = (us_since_start(rx) - (seq & kTsMask)) & kTsMask;
+        return us / 1000.0;
+    };
+
+    std::size_t sent = 0, replies = 0, unmatched = 0;
+    EventLoop loop;
+
+    // ICMP Time Exceeded: the quote has everything
+    auto on_time_exceeded = [&](const IcmpListener::TimeExceeded &te) {
+        uint64_t idx = (uint64_t{te.orig_ip_id} - 1) << kLowBits | (te.orig_sport & kLowMask);
+        if (!(te.orig_sport & kSportTag) || te.orig_ip_id == 0 || idx >= tg.size() ||
+            tg[idx].dst.s_addr != te.orig_dst || te.orig_dport != tg[idx].port)
+        {
+            unmatched++;
+            return;
+        }
+        SweepReply r;
+        r.target = static_cast<std::size_t>(idx);
+        r.ttl = static_cast<int>(te.orig_seq >> kTsBits);
+        r.hop_addr = te.from_addr;
+        r.rtt_ms = rtt_ms(te.orig_seq, te.rx_time);
+        r.reached = false;
+        replies++;
+        if (diag)
+            diag->event(diag::sweep_reply(static_cast<uint32_t>(r.target), diag::ReplyKind::Icmp, r.ttl,
+                                          r.hop_addr, std::llround(r.rtt_ms * 1e6)));
+        on_reply(r);
+    };
+
+    // SYN-ACK / RST: ack - 1 is our seq, dport our sport, saddr the target
+    RecvRing tcp_rx;
+    auto on_tcp_segment = [&](const uint8_t *buf, std::size_t n, clk::time_point at) {
+        if (n < sizeof(iphdr))
+            return;
+        auto *ip = reinterpret_cast<const iphdr *>(buf);
+        size_t off = ip->ihl * 4;
+        if (off + sizeof(tcphdr) > n)
+            return;
+        auto *tcp = reinterpret_cast<const tcphdr *>(buf + off);
+        uint16_t dport = ntohs(tcp->dest);
+        bool synack = (TCP_IS_SYN(tcp) && TCP_IS_ACK(tcp));
+        bool rst = TCP_IS_RST(tcp);
+        if (!(dport & kSportTag) || !(synack || rst))
+            return;
+
+        const uint16_t sport = ntohs(tcp->source);
+        std::size_t idx = dport & kLowMask;
+        while (idx < tg.size() && (tg[idx].dst.s_addr != ip->saddr || tg[idx].port != sport))
+            idx += std::size_t{1} << kLowBits;
+        if (idx >= tg.size())
+        {
+            unmatched++;
+            return;
+        }
+        uint32_t seq = ntohl(tcp->ack_seq) - 1;
+        SweepReply r;
+        r.target = idx;
+        r.ttl = static_cast<int>(seq >> kTsBits);
+        r.hop_addr = ip->saddr;
+        r.rtt_ms = rtt_ms(seq, at);
+        r.reached = true;
+        replies++;
+        if (diag)
+            diag->event(diag::sweep_reply(static_cast<uint32_t>(r.target),
+                                          synack ? diag::ReplyKind::SynAck : diag::ReplyKind::Rst, r.ttl,
+                                          r.hop_addr, std::llround(r.rtt_ms * 1e6)));
+        on_reply(r);
+    };
+
+    if (use_ring)
+    {
+        loop.watch(ring.fd(), EPOLLIN, [&](uint32_t) {
+            ring.drain([&](const uint8_t *pkt, std::size_t n, clk::time_point at) {
+                if (n < sizeof(iphdr))
+                    return;
+                const uint8_t proto = reinterpret_cast<const iphdr *>(pkt)->protocol;
+                if (proto == IPPROTO_TCP)
+                {
+                    on_tcp_segment(pkt, n, at);
+                }
+                else if (proto == IPPROTO_ICMP)
+                {
+                    if (auto te = IcmpListener::parse_time_exceeded(pkt, n))
+                    {
+                        te->rx_time = at;
+                        on_time_exceeded(*te);
+                    }
+                }
+            });
+        });
+    }
+    else
+    {
+        loop.watch(icmp.fd(), EPOLLIN, [&](uint32_t) {
+            for (const auto &te : icmp.recv_time_exceeded_batch())
+                on_time_exceeded(te);
+        });
+        loop.watch(tcp_recv_sock, EPOLLIN, [&](uint32_t) {
+            const int n = tcp_rx.drain(tcp_recv_sock);
+            for (int i = 0; i < n; ++i)
+                on_tcp_segment(tcp_rx.data(i), tcp_rx.len(i), tcp_rx.received_at(i));
+        });
+    }
+
+    // --- walk the (target, ttl) space in permuted order
+    Permutation perm(total, seed);
+    uint64_t walked = 0;
+    const clk::duration step = opt.probes_per_sec > 0
+        ? std::chrono::duration_cast<clk::duration>(std::chrono::duration<double>(1.0 / opt.probes_per_sec))
+        : clk::duration::zero();
+    clk::time_point pace_next = clk::now();
+    clk::time_point drain_until = clk::time_point::max();
+    std::vector<uint64_t> expired; // unused: the sweep keeps no timers
+    RawSynBatch tx;
+
+    for (;;)
+    {
+        int burst = 0;
+        auto now = clk::now();
+        while (walked < total && burst < kBurst && (step == clk::duration::zero() || now >= pace_next))
+        {
+            uint64_t x = perm.next();
+            walked++;
+            std::size_t idx = static_cast<std::size_t>(x / max_ttl);
+            int ttl = static_cast<int>(x % max_ttl) + 1;
+            if (!usable[idx])
+                continue;
+
+            sockaddr_in dst{};
+            dst.sin_family = AF_INET;
+            dst.sin_port = htons(tg[idx].port);
+            dst.sin_addr = tg[idx].dst;
+            uint16_t sport = static_cast<uint16_t>(kSportTag | (idx & kLowMask));
+            uint16_t ip_id = static_cast<uint16_t>((idx >> kLowBits) + 1);
+            uint32_t seq = (static_cast<uint32_t>(ttl) << kTsBits) | (now_us() & kTsMask);
+
+            tx.add(dst, tg[idx].syn, sport, ttl, ip_id, seq,
+                   static_cast<uint32_t>(idx), 0);
+            sent++;
+            burst++;
+            if (step != clk::duration::zero())
+                pace_next = std::max(pace_next, now - std::chrono::milliseconds(10)) + step;
+        }
+
+        if (!tx.empty())
+        {
+            if (packet)
+                tx.flush(links);
+            else
+                tx.flush(raw_send_sock);
+            for (int i = 0; diag && i < tx.size(); ++i)
+            {
+                const auto &m = tx.meta(i);
+                if (m.result < 0)
+                    diag->event(diag::probe_sent(diag::ProbeKind::Sweep, m.target, m.ttl, 0, m.sport, m.result));
+            }
+            tx.clear();
+        }
+
+        now = clk::now();
+        if (walked == total && drain_until == clk::time_point::max())
+            drain_until = now + std::chrono::milliseconds(opt.timeout_ms);
+        if (now >= drain_until)
+            break;
+
+        // sleep until the next pacing slot (or the end of the drain window)
+        int wait;
+        if (walked < total)
+            wait = step == clk::duration::zero()
+                ? 0
+                : static_cast<int>(std::max<long long>(
+                      std::chrono::ceil<std::chrono::milliseconds>(pace_next - now).count(), 0));
+        else
+            wait = static_cast<int>(std::chrono::ceil<std::chrono::milliseconds>(drain_until - now).count());
+        loop.poll_once(wait, expired);
+    }
+
+    if (use_ring)
+    {
+        loop.unwatch(ring.fd());
+        ring.close();
+    }
+    else
+    {
+        loop.unwatch(icmp.fd());
+        loop.unwatch(tcp_recv_sock);
+        ::close(tcp_recv_sock);
+    }
+    if (raw_send_sock >= 0)
+        ::close(raw_send_sock);
+
+    if (diag)
+        diag->log("SWEEP_DONE sent=" + std::to_string(sent) +
+                  " replies=" + std::to_string(replies) +
+                  " unmatched=" + std::to_string(unmatched));
+}
+
+} // namespace geo
@@ -0,0 +1,154 @@
+// ===================== File: src/timer_wheel.cpp =====================
+#include "timer_wheel.hpp"
+
+#include <algorithm>
+
+namespace geo {
+
+TimerWheel::TimerWheel(clock::time_point start) : start_(start) {
+    heads_.fill(kNil);
+}
+
+uint64_t TimerWheel::tick_of(clock::time_point tp) const {
+    if (tp <= start_) return 0;
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(tp - start_).count());
+}
+
+TimerWheel::TimerId TimerWheel::schedule(clock::time_point when, uint64_t token) {
+    uint32_t idx;
+    if (!free_.empty()) {
+        idx = free_.back();
+        free_.pop_back();
+    } else {
+        idx = static_cast<uint32_t>(nodes_.size());
+        nodes_.push_back(Node{});
+    }
+
+    // round up: a timer must never fire before `when`
+    uint64_t expiry = 0;
+    if (when > start_)
+        expiry = static_cast<uint64_t>(
+            std::chrono::ceil<std::chrono::milliseconds>(when - start_).count());
+
+    Node& n = nodes_[idx];
+    n.token  = token;
+    n.expiry = std::max(expiry, now_tick_ + 1);
+    n.live   = true;
+    link(idx);
+    ++live_;
+    return (static_cast<TimerId>(n.gen) << 32) | idx;
+}
+
+bool TimerWheel::cancel(TimerId id) {
+    if (id == kInvalid) return false;
+    uint32_t idx = static_cast<uint32_t>(id & 0xFFFFFFFFu);
+    uint32_t gen = static_cast<uint32_t>(id >> 32);
+    if (idx >= nodes_.size()) return false;
+    Node& n = nodes_[idx];
+    if (!n.live || n.gen != gen) return false;
+
+    unlink(idx);
+    n.live = false;
+    n.gen++;
+    free_.push_back(idx);
+    --live_;
+    return true;
+}
+
+// Place a node in the finest level whose span still covers its expiry.
+void TimerWheel::link(uint32_t idx) {
+    Node& n = nodes_[idx];
+    uint64_t diff = n.expiry - now_tick_;
+    uint64_t when = n.expiry;
+
+    int level = 0;
+    while (level < kLevels - 1 && diff >= (uint64_t{1} << (kSlotBits * (level + 1))))
+        ++level;
+    if (level == kLevels - 1) {
+        // past the horizon: park in the furthest slot, cascade will retry
+        const uint64_t horizon = (uint64_t{1} << (kSlotBits * kLevels)) - 1;
+        if (diff > horizon) when = now_tick_ + horizon;
+    }
+
+    int index = static_cast<int>((when >> (kSlotBits * level)) & (kSlots - 1));
+    n.slot = static_cast<uint16_t>(level * kSlots + index);
+    n.prev = kNil;
+    n.next = heads_[n.slot];
+    if (n.next != kNil) nodes_[n.next].prev = idx;
+    heads_[n.slot] = idx;
+}
+
+void TimerWheel::unlink(uint32_t idx) {
+    Node& n = nodes_[idx];
+    if (n.prev != kNil) nodes_[n.prev].next = n.next;
+    else                heads_[n.slot] = n.next;
+    if (n.next != kNil) nodes_[n.next].prev = n.prev;
+    n.prev = n.next = kNil;
+}
+
+// Re-distribute one coarse slot into finer levels.
+void TimerWheel::cascade(int level, int index) {
+    uint32_t idx = heads_[level * kSlots + index];
+    heads_[level * kSlots + index] = kNil;
+    while (idx != kNil) {
+        uint32_t next = nodes_[idx].next;
+        link(idx);
+        idx = next;
+    }
+}
+
+void TimerWheel::advance(clock::time_point now, std::vector<uint64_t>& expired) {
+    const uint64_t target = tick_of(now);
+    if (live_ == 0) {
+        now_tick_ = std::max(now_tick_, target);
+        return;
+    }
+
+    while (now_tick_ < target) {
+        ++now_tick_;
+
+        // lower levels wrap first, then the next one up
+        for (int level = 1; level < kLevels; ++level) {
+            if ((now_tick_ & ((uint64_t{1} << (kSlotBits * level)) - 1)) != 0) break;
+            cascade(level, static_cast<int>((now_tick_ >> (kSlotBits * level)) & (kSlots - 1)));
+        }
+
+        const int slot = static_cast<int>(now_tick_ & (kSlots - 1));
+        uint32_t idx = heads_[slot];
+        heads_[slot] = kNil;
+        while (idx != kNil) {
+            Node& n = nodes_[idx];
+            uint32_t next = n.next;
+            expired.push_back(n.token);
+            n.live = false;
+            n.gen++;
+            free_.push_back(idx);
+            --live_;
+            idx = next;
+        }
+
+        if (live_ == 0) {
+            now_tick_ = target;
+            break;
+        }
+    }
+}
+
+int TimerWheel::ms_until_next(clock::time_point now) const {
+    if (live_ == 0) return -1;
+
+    // first non-empty level-0 slot, or the next cascade point
+    uint64_t t = now_tick_ + 1;
+    for (; t <= now_tick_ + kSlots; ++t) {
+        if ((t & (kSlots - 1)) == 0) break;
+        if (heads_[t & (kSlots - 1)] != kNil) break;
+    }
+
+    auto due = start_ + std::chrono::milliseconds(t);
+    if (due <= now) return 0;
+    return static_cast<int>(
+        std::chrono::ceil<std::chrono::milliseconds>(due - now).count());
+}
+
+} // namespace geo
@@ -1,46 +1,219 @@
 #include "utils_net.hpp"
-#include <vector>
+#include <algorithm>
 #include <cstring>
 #include <stdexcept>
+#include <string>
 #include <arpa/inet.h> // htons
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
 namespace geo::net {
 
-uint16_t csum16(const void* data, std::size_t len) {
-    const uint16_t* p = static_cast<const uint16_t*>(data);
-    uint32_t sum = 0;
-    while (len > 1) { sum += *p++; len -= 2; }
-    if (len) sum += *reinterpret_cast<const uint8_t*>(p);
+namespace {
+
+// Every kernel returns the plain (unfolded) 64-bit sum of the buffer's 16-bit
+// words in memory order, plus `p`/`len` advanced past what it consumed.
+// Folding is deferred to the caller; since 2^16 == 1 (mod 0xFFFF), how the
+// words get grouped on the way doesn't change the folded result.
+
+// Portable: 8 bytes per step as two 32-bit halves into a 64-bit accumulator.
+uint64_t sum_scalar(const uint8_t*& p, std::size_t& len) {
+    uint64_t acc = 0;
+    while (len >= 8) {
+        uint32_t a, b;
+        std::memcpy(&a, p, sizeof(a));
+        std::memcpy(&b, p + 4, sizeof(b));
+        acc += (a & 0xFFFF) + (a >> 16) + (b & 0xFFFF) + (b >> 16);
+        p += 8;
+        len -= 8;
+    }
+    return acc;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// 32-bit lanes take at most 2 * 0xFFFF per iteration; flush them to the
+// 64-bit total before they can wrap.
+constexpr std::size_t kLaneFlush = 16384;
+
+__attribute__((target("sse2")))
+uint64_t sum_sse2(const uint8_t*& p, std::size_t& len) {
+    const __m128i zero = _mm_setzero_si128();
+    uint64_t total = 0;
+    while (len >= 16) {
+        std::size_t n = std::min(len / 16, kLaneFlush);
+        __m128i acc = zero;
+        for (std::size_t i = 0; i < n; ++i, p += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(v, zero));
+            acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(v, zero));
+        }
+        len -= n * 16;
+        alignas(16) uint32_t lanes[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes), acc);
+        for (uint32_t l : lanes) total += l;
+    }
+    return total;
+}
+
+__attribute__((target("avx2")))
+uint64_t sum_avx2(const uint8_t*& p, std::size_t& len) {
+    uint64_t total = 0;
+    if (len >= 64) {
+        const __m256i zero = _mm256_setzero_si256();
+        while (len >= 64) {
+            std::size_t n = std::min(len / 64, kLaneFlush);
+            // two accumulators so consecutive adds don't serialise
+            __m256i acc0 = zero, acc1 = zero;
+            for (std::size_t i = 0; i < n; ++i, p += 64) {
+                __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+                __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+                acc0 = _mm256_add_epi32(acc0, _mm256_unpacklo_epi16(v0, zero));
+                acc1 = _mm256_add_epi32(acc1, _mm256_unpackhi_epi16(v0, zero));
+                acc0 = _mm256_add_epi32(acc0, _mm256_unpacklo_epi16(v1, zero));
+                acc1 = _mm256_add_epi32(acc1, _mm256_unpackhi_epi16(v1, zero));
+            }
+            len -= n * 64;
+            alignas(32) uint32_t lanes[16];
+            _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), acc0);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(lanes + 8), acc1);
+            for (uint32_t l : lanes) total += l;
+        }
+        // clean upper YMM state, or every legacy-SSE instruction after this
+        // (the caller's included) pays the AVX-SSE transition
+        _mm256_zeroupper();
+    }
+    // 16..63 byte tail in 128-bit VEX registers, not a call into sum_sse2()
+    if (len >= 16) {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i acc = zero;
+        for (; len >= 16; p += 16, len -= 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(v, zero));
+            acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(v, zero));
+        }
+        alignas(16) uint32_t lanes[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes), acc);
+        for (uint32_t l : lanes) total += l;
+    }
+    return total;
+}
+
+#endif
+
+using SumFn = uint64_t (*)(const uint8_t*&, std::size_t&);
+
+SumFn kernel_for(CsumImpl impl) {
+    switch (impl) {
+#if defined(__x86_64__) || defined(__i386__)
+    case CsumImpl::Avx2: return sum_avx2;
+    case CsumImpl::Sse2: return sum_sse2;
+#endif
+    default:             return sum_scalar;
+    }
+}
+
+CsumImpl pick_impl() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init(); // we run from a static initialiser
+#endif
+    if (csum_impl_supported(CsumImpl::Avx2)) return CsumImpl::Avx2;
+    if (csum_impl_supported(CsumImpl::Sse2)) return CsumImpl::Sse2;
+    return CsumImpl::Scalar;
+}
+
+const CsumImpl g_impl = pick_impl();
+const SumFn g_sum = kernel_for(g_impl);
+
+uint32_t csum_run(SumFn fn, const void* data, std::size_t len, uint32_t sum) {
+    const auto* p = static_cast<const uint8_t*>(data);
+    uint64_t acc = sum + fn(p, len);
+    while (len > 1) {
+        uint16_t w;
+        std::memcpy(&w, p, sizeof(w));
+        acc += w;
+        p += 2;
+        len -= 2;
+    }
+    if (len) acc += *p;
+    while (acc >> 32) acc = (acc & 0xFFFFFFFF) + (acc >> 32);
+    return static_cast<uint32_t>(acc);
+}
+
+} // namespace
+
+bool csum_impl_supported(CsumImpl impl) {
+    switch (impl) {
+    case CsumImpl::Scalar: return true;
+#if defined(__x86_64__) || defined(__i386__)
+    case CsumImpl::Sse2:   return __builtin_cpu_supports("sse2");
+    case CsumImpl::Avx2:   return __builtin_cpu_supports("avx2");
+#endif
+    default:               return false;
+    }
+}
+
+const char* csum_impl_name(CsumImpl impl) {
+    switch (impl) {
+    case CsumImpl::Scalar: return "scalar";
+    case CsumImpl::Sse2:   return "sse2";
+    case CsumImpl::Avx2:   return "avx2";
+    }
+    return "?";
+}
+
+CsumImpl csum_active_impl() {
+    return g_impl;
+}
+
+uint32_t csum_partial_impl(CsumImpl impl, const void* data, std::size_t len, uint32_t sum) {
+    if (!csum_impl_supported(impl))
+        throw std::invalid_argument(std::string("checksum kernel not supported: ") + csum_impl_name(impl));
+    return csum_run(kernel_for(impl), data, len, sum);
+}
+
+uint32_t csum_partial(const void* data, std::size_t len, uint32_t sum) {
+    return csum_run(g_sum, data, len, sum);
+}
+
+uint16_t csum_fold(uint32_t sum) {
     while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
     return static_cast<uint16_t>(~sum);
 }
 
+uint16_t csum16(const void* data, std::size_t len) {
+    return csum_fold(csum_partial(data, len, 0));
+}
+
+uint16_t csum_replace16(uint16_t check, uint16_t old_word, uint16_t new_word) {
+    // RFC 1624 eqn. 3: HC' = ~(~HC + ~m + m')
+    uint32_t sum = static_cast<uint16_t>(~check);
+    sum += static_cast<uint16_t>(~old_word);
+    sum += new_word;
+    return csum_fold(sum);
+}
+
 uint16_t ip_checksum(const iphdr* ip) {
     return csum16(ip, ip->ihl * 4);
 }
 
 uint16_t tcp_checksum(const iphdr* ip, const tcphdr* tcp, std::size_t tcplen)
 {
-    struct Pseudo {
-        uint32_t saddr;
-        uint32_t daddr;
-        uint8_t  zero;
-        uint8_t  proto;
-        uint16_t len;
-    } ph { ip->saddr, ip->daddr, 0, IPPROTO_TCP,
-           htons(static_cast<uint16_t>(tcplen)) };
-
     if (tcplen > 65535)
         throw std::runtime_error("invalid TCP length for checksum");
 
-    std::vector<uint8_t> buf(sizeof(Pseudo) + tcplen);
-
-    std::memcpy(static_cast<void*>(buf.data()), &ph, sizeof(Pseudo));
-    std::memcpy(static_cast<void*>(buf.data() + sizeof(Pseudo)),
-                static_cast<const void*>(tcp),
-                tcplen);
+    // pseudo-header words summed in place: saddr, daddr, zero+proto, length
+    uint32_t sum = 0;
+    sum += ip->saddr & 0xFFFF;
+    sum += ip->saddr >> 16;
+    sum += ip->daddr & 0xFFFF;
+    sum += ip->daddr >> 16;
+    sum += htons(IPPROTO_TCP);
+    sum += htons(static_cast<uint16_t>(tcplen));
 
-    return csum16(buf.data(), buf.size());
+    return csum_fold(csum_partial(tcp, tcplen, sum));
 }
 
 